@@ -32,6 +32,8 @@
  * @brief C++ interface to the sJSON library.
  */
 
+#include <stdio.h>
+#include <string.h>
 #include "sjson.h"
 #include "eastl/string.h"
 #include "eastl/vector.h"
@@ -76,7 +78,7 @@ public:
     * @return @c true if the value is null, else @c false.
     */
    bool isNull() const {
-      return (myData->type == sJSON_NULL);
+      return ((myData->type & sJSON_TypeMask) == sJSON_NULL);
    }
 
    /*!
@@ -86,7 +88,7 @@ public:
     * @see operator bool()
     */
    bool isBool() const {
-      return ((myData->type == sJSON_True) || (myData->type == sJSON_False));
+      return (((myData->type & sJSON_TypeMask) == sJSON_True) || ((myData->type & sJSON_TypeMask) == sJSON_False));
    }
 
    /*!
@@ -101,7 +103,7 @@ public:
     * @see operator double()
     */
    bool isNumber() const {
-      return (myData->type == sJSON_Number);
+      return ((myData->type & sJSON_TypeMask) == sJSON_Number);
    }
 
    /*!
@@ -111,7 +113,7 @@ public:
     * @see operator eastl::string()
     */
    bool isString() const {
-      return (myData->type == sJSON_String);
+      return ((myData->type & sJSON_TypeMask) == sJSON_String);
    }
 
    /*!
@@ -121,7 +123,7 @@ public:
     * @see Array::Array(const Any&)
     */
    bool isArray() const {
-      return (myData->type == sJSON_Array);
+      return ((myData->type & sJSON_TypeMask) == sJSON_Array);
    }
 
    /*!
@@ -131,7 +133,7 @@ public:
     * @see Map::Map(const Any&)
     */
    bool isMap() const {
-      return (myData->type == sJSON_Object);
+      return ((myData->type & sJSON_TypeMask) == sJSON_Object);
    }
 
    /* operators. */
@@ -156,7 +158,7 @@ public:
 //      }
 //   }
    bool asBool() const {
-      switch (myData->type) {
+      switch (myData->type & sJSON_TypeMask) {
       case sJSON_False: {
          return (false);
       }
@@ -183,7 +185,7 @@ public:
 //   }
    int asInt() const {
       XASSERT(isNumber(), "operator int used on non int json object");
-      return (myData->valueInt);
+      return ::sJSONgetNumberInt(myData);
    }
 
    /*!
@@ -200,7 +202,7 @@ public:
 //   }
    double asDouble() const {
       XASSERT(isNumber(), "operator double used on non double json object");
-      return (myData->valueDouble);
+      return ::sJSONgetNumberDouble(myData);
    }
 
    /*!
@@ -216,7 +218,10 @@ public:
 
    eastl::string asString() const {
       XASSERT(isString(), "operator string used on non string json object");
-      return myData->valueString;
+      size_t length;
+      const char *const string = ::sJSONgetStringView(myData, &length);
+      XASSERT(string != 0, "json string out of memory");
+      return eastl::string(string, length);
    }
 };
 
@@ -233,10 +238,11 @@ private:
     * @internal
     * @brief Parse the JSON document in @a text.
     * @param text Serialized JSON document.
+    * @param options Parse options, may be null.
     * @return A handle to the JSON data structure.
     */
-   static ::sJSON* parse(const eastl::string& text) {
-      ::sJSON *const root = ::sJSONparse(text.c_str());
+   static ::sJSON* parse(const eastl::string& text, const ::sJSON_ParseOptions *options = 0) {
+      ::sJSON *const root = ::sJSONparseWithOptions(text.c_str(), options);
       XASSERT(root != nullptr, "json parse error!");
       // sJSONgetErrorPtr()
       return root;
@@ -244,6 +250,7 @@ private:
 
    /* data. */
 private:
+   eastl::string myText;
    ::sJSON *const myData;
 
    /* construction. */
@@ -256,6 +263,16 @@ public:
       : myData(parse(text.c_str()))
    {}
 
+   /*!
+    * @brief Parse the JSON document in @a text with @a options.
+    * @param text Serialized JSON document, copied into the document so
+    *  lazily parsed values can refer to it.
+    * @param options Parse options.
+    */
+   Document(const eastl::string& text, const ::sJSON_ParseOptions& options)
+      : myText(text), myData(parse(myText, &options))
+   {}
+
 private:
    Document(const Document&);
 
@@ -287,7 +304,7 @@ public:
     * @see Array(Document&)
     */
    bool isArray() const {
-      return (myData->type == sJSON_Array);
+      return ((myData->type & sJSON_TypeMask) == sJSON_Array);
    }
 
    /*!
@@ -297,7 +314,7 @@ public:
     * @see Map(Document&)
     */
    bool isMap() const {
-      return (myData->type == sJSON_Object);
+      return ((myData->type & sJSON_TypeMask) == sJSON_Object);
    }
 
    /* operators. */
@@ -328,7 +345,7 @@ public:
    explicit Array(::sJSON* data)
       : myData(data)
    {
-      XASSERT(myData->type == sJSON_Array, "json object is not an array");
+      XASSERT((myData->type & sJSON_TypeMask) == sJSON_Array, "json object is not an array");
    }
 
    /*!
@@ -342,7 +359,7 @@ public:
    explicit Array(Document& document)
       : myData(document.data())
    {
-      XASSERT(myData->type == sJSON_Array, "json object is not an array");
+      XASSERT((myData->type & sJSON_TypeMask) == sJSON_Array, "json object is not an array");
    }
 
    /*!
@@ -354,7 +371,7 @@ public:
    Array(const Any& object)
       : myData(object.data())
    {
-      XASSERT(myData->type == sJSON_Array, "json object is not an array");
+      XASSERT((myData->type & sJSON_TypeMask) == sJSON_Array, "json object is not an array");
    }
 
    /* methods. */
@@ -421,7 +438,7 @@ public:
    explicit Map(::sJSON * data)
       : myData(data)
    {
-      XASSERT(myData->type == sJSON_Object, "json object is not map");
+      XASSERT((myData->type & sJSON_TypeMask) == sJSON_Object, "json object is not map");
    }
 
    /*!
@@ -435,7 +452,7 @@ public:
    explicit Map(Document& document)
       : myData(document.data())
    {
-      XASSERT(myData->type == sJSON_Object, "json object is not map");
+      XASSERT((myData->type & sJSON_TypeMask) == sJSON_Object, "json object is not map");
    }
 
    /*!
@@ -447,7 +464,7 @@ public:
    Map(const Any& object)
       : myData(object.data())
    {
-      XASSERT(myData->type == sJSON_Object, "json object is not map");
+      XASSERT((myData->type & sJSON_TypeMask) == sJSON_Object, "json object is not map");
    }
 
    /* operators. */
@@ -493,6 +510,479 @@ public:
 
 };
 
+/*!
+ * @brief Name of a map member together with its hash.
+ *
+ * String literals are hashed at compile time through
+ * @c eastl::FixedMurmurHash, other strings have to be wrapped explicitly.
+ */
+class Key {
+   /* data. */
+private:
+   const char * myName;
+   uint32_t myHash;
+
+   /* construction. */
+public:
+   /*!
+    * @brief Wraps a string literal.
+    * @param name Member name, hashed at compile time.
+    */
+   template<size_t N>
+   Key(const char (&name)[N])
+      : myName(name), myHash(eastl::FixedMurmurHash(name))
+   {}
+
+   /*!
+    * @brief Wraps a string built at runtime.
+    * @param name Member name, must outlive the key.
+    */
+   explicit Key(const char *name)
+      : myName(name), myHash(eastl::murmurString(name))
+   {}
+
+   /* methods. */
+public:
+   const char *name() const {
+      return myName;
+   }
+
+   uint32_t hash() const {
+      return myHash;
+   }
+};
+
+/*!
+ * @brief Streams JSON text without building a tree.
+ *
+ * The output is identical to what sJSONprintUnformatted() produces for the
+ * same data. Text is collected in a small internal buffer which is handed to
+ * the sink (or appended to the target string) whenever it fills up, on
+ * flush() and on destruction.
+ *
+ * @code
+ * eastl::string out;
+ * json::Writer writer(out);
+ * writer.beginObject()
+ *          .value("name", "rect")
+ *          .beginArray("size").value(1920).value(1080).endArray()
+ *       .endObject();
+ * writer.flush();
+ * @endcode
+ */
+class Writer {
+public:
+   /*!
+    * @brief Receives a chunk of generated text.
+    */
+   typedef void (*Sink)(void *user, const char *data, size_t length);
+
+   /* data. */
+private:
+   enum { BufferSize = 1024, MaxDepth = 64 };
+
+   Sink mySink;
+   void * myUser;
+   eastl::string * myString;
+   char myBuffer[BufferSize];
+   size_t myUsed;
+   int myDepth;
+   bool myFirst[MaxDepth];
+
+   /* construction. */
+public:
+   /*!
+    * @brief Append the generated text to @a out.
+    */
+   explicit Writer(eastl::string& out)
+      : mySink(0), myUser(0), myString(&out), myUsed(0), myDepth(0)
+   {}
+
+   /*!
+    * @brief Hand the generated text to @a sink in chunks.
+    */
+   Writer(Sink sink, void *user)
+      : mySink(sink), myUser(user), myString(0), myUsed(0), myDepth(0)
+   {}
+
+   ~Writer() {
+      flush();
+   }
+
+private:
+   Writer(const Writer&);
+   Writer& operator= (const Writer&);
+
+   /* methods. */
+public:
+   Writer& beginObject() {
+      separate();
+      return open('{');
+   }
+   Writer& beginObject(const char *key) {
+      member(key);
+      return open('{');
+   }
+   Writer& endObject() {
+      return close('}');
+   }
+
+   Writer& beginArray() {
+      separate();
+      return open('[');
+   }
+   Writer& beginArray(const char *key) {
+      member(key);
+      return open('[');
+   }
+   Writer& endArray() {
+      return close(']');
+   }
+
+   /*!
+    * @brief Array elements (or the root value).
+    */
+   Writer& value(int number) {
+      separate();
+      return putNumber(number);
+   }
+   Writer& value(double number) {
+      separate();
+      return putNumber(number);
+   }
+   Writer& value(bool flag) {
+      separate();
+      return put(flag ? "true" : "false", flag ? 4 : 5);
+   }
+   Writer& value(const char *string) {
+      separate();
+      return putString(string);
+   }
+   Writer& null() {
+      separate();
+      return put("null", 4);
+   }
+
+   /*!
+    * @brief Object members.
+    */
+   Writer& value(const char *key, int number) {
+      member(key);
+      return putNumber(number);
+   }
+   Writer& value(const char *key, double number) {
+      member(key);
+      return putNumber(number);
+   }
+   Writer& value(const char *key, bool flag) {
+      member(key);
+      return put(flag ? "true" : "false", flag ? 4 : 5);
+   }
+   Writer& value(const char *key, const char *string) {
+      member(key);
+      return putString(string);
+   }
+   Writer& null(const char *key) {
+      member(key);
+      return put("null", 4);
+   }
+
+   /*!
+    * @brief Pass the buffered text on to the sink or string.
+    */
+   void flush() {
+      if (myUsed == 0)
+         return;
+      if (myString)
+         myString->append(myBuffer, myUsed);
+      else
+         mySink(myUser, myBuffer, myUsed);
+      myUsed = 0;
+   }
+
+private:
+   void separate() {
+      if (myDepth > 0) {
+         if (!myFirst[myDepth-1])
+            put(',');
+         myFirst[myDepth-1] = false;
+      }
+   }
+
+   void member(const char *key) {
+      separate();
+      putString(key);
+      put(':');
+   }
+
+   Writer& open(char bracket) {
+      XASSERT(myDepth < MaxDepth, "json writer nested too deep");
+      put(bracket);
+      myFirst[myDepth++] = true;
+      return *this;
+   }
+
+   Writer& close(char bracket) {
+      XASSERT(myDepth > 0, "json writer end without begin");
+      --myDepth;
+      return put(bracket);
+   }
+
+   Writer& put(char c) {
+      if (myUsed == BufferSize)
+         flush();
+      myBuffer[myUsed++] = c;
+      return *this;
+   }
+
+   Writer& put(const char *data, size_t length) {
+      if (myUsed + length > BufferSize) {
+         flush();
+         if (length > BufferSize) {
+            if (myString)
+               myString->append(data, length);
+            else
+               mySink(myUser, data, length);
+            return *this;
+         }
+      }
+      memcpy(myBuffer + myUsed, data, length);
+      myUsed += length;
+      return *this;
+   }
+
+   Writer& putNumber(double number) {
+      char text[64];
+      return put(text, ::sJSONformatNumber(number, text));
+   }
+
+   /* Same escaping as the sJSON printer. */
+   Writer& putString(const char *string) {
+      put('\"');
+      const char *run = string;
+      for (const char *ptr = string; *ptr; ++ptr) {
+         const unsigned char c = (unsigned char)*ptr;
+         if (c > 31 && c != '\"' && c != '\\')
+            continue;
+         put(run, ptr - run);
+         run = ptr + 1;
+         switch (c) {
+            case '\\': put("\\\\", 2); break;
+            case '\"': put("\\\"", 2); break;
+            case '\b': put("\\b", 2); break;
+            case '\f': put("\\f", 2); break;
+            case '\n': put("\\n", 2); break;
+            case '\r': put("\\r", 2); break;
+            case '\t': put("\\t", 2); break;
+            default: {
+               char escaped[8];
+               put(escaped, sprintf(escaped, "\\u%04x", c));
+            }
+         }
+      }
+      put(run, strlen(run));
+      return put('\"');
+   }
+};
+
+/*!
+ * @brief Builds a tree in an arena.
+ *
+ * All items and strings are allocated from an arena owned by the builder,
+ * so building costs no malloc per item and the whole tree is released at
+ * once when the builder is destroyed or reset. Do not call sJSONdelete()
+ * on the result.
+ *
+ * @code
+ * json::Builder builder;
+ * builder.beginObject()
+ *           .value("name", "rect")
+ *           .beginObject("format").value("width", 1920).endObject()
+ *        .endObject();
+ * json::Map root(builder.root());
+ * @endcode
+ */
+class Builder {
+   /* data. */
+private:
+   struct Level {
+      ::sJSON * container;
+      ::sJSON * last;
+   };
+
+   ::sJSON_Arena * myArena;
+   ::sJSON * myRoot;
+   eastl::vector<Level> myStack;
+
+   /* construction. */
+public:
+   /*!
+    * @param blockSize Arena block size, 0 selects the default.
+    */
+   explicit Builder(size_t blockSize = 0)
+      : myArena(::sJSONarenaCreate(blockSize)), myRoot(0)
+   {
+      XASSERT(myArena != 0, "json builder out of memory");
+   }
+
+   ~Builder() {
+      release();
+      ::sJSONarenaDelete(myArena);
+   }
+
+private:
+   Builder(const Builder&);
+   Builder& operator= (const Builder&);
+
+   /* methods. */
+public:
+   /*!
+    * @brief The finished tree, owned by the builder.
+    */
+   ::sJSON *root() const {
+      XASSERT(myStack.empty(), "json builder has open containers");
+      return myRoot;
+   }
+
+   /*!
+    * @brief Drop the current tree and start a new one, keeping the arena memory.
+    */
+   void reset() {
+      release();
+      ::sJSONarenaReset(myArena);
+      myRoot = 0;
+      myStack.clear();
+   }
+
+   Builder& beginObject() {
+      return open(add(0, sJSON_Object));
+   }
+   Builder& beginObject(const Key& key) {
+      return open(add(&key, sJSON_Object));
+   }
+   Builder& endObject() {
+      return close(sJSON_Object);
+   }
+
+   Builder& beginArray() {
+      return open(add(0, sJSON_Array));
+   }
+   Builder& beginArray(const Key& key) {
+      return open(add(&key, sJSON_Array));
+   }
+   Builder& endArray() {
+      return close(sJSON_Array);
+   }
+
+   /*!
+    * @brief Array elements (or the root value).
+    */
+   Builder& value(int number) {
+      setNumber(add(0, sJSON_Number), number);
+      return *this;
+   }
+   Builder& value(double number) {
+      setNumber(add(0, sJSON_Number), number);
+      return *this;
+   }
+   Builder& value(bool flag) {
+      add(0, flag ? sJSON_True : sJSON_False)->valueInt = flag;
+      return *this;
+   }
+   Builder& value(const char *string) {
+      setString(add(0, sJSON_String), string);
+      return *this;
+   }
+   Builder& null() {
+      add(0, sJSON_NULL);
+      return *this;
+   }
+
+   /*!
+    * @brief Object members.
+    */
+   Builder& value(const Key& key, int number) {
+      setNumber(add(&key, sJSON_Number), number);
+      return *this;
+   }
+   Builder& value(const Key& key, double number) {
+      setNumber(add(&key, sJSON_Number), number);
+      return *this;
+   }
+   Builder& value(const Key& key, bool flag) {
+      add(&key, flag ? sJSON_True : sJSON_False)->valueInt = flag;
+      return *this;
+   }
+   Builder& value(const Key& key, const char *string) {
+      setString(add(&key, sJSON_String), string);
+      return *this;
+   }
+   Builder& null(const Key& key) {
+      add(&key, sJSON_NULL);
+      return *this;
+   }
+
+private:
+   /* Strings set through the API and cached texts of the containers live on the heap. */
+   void release() {
+      if (myRoot)
+         ::sJSONdelete(myRoot);
+   }
+
+   ::sJSON *add(const Key *key, int type) {
+      ::sJSON *const item = ::sJSONarenaNewItem(myArena);
+      XASSERT(item != 0, "json builder out of memory");
+      item->type |= type;
+      if (myStack.empty()) {
+         XASSERT(myRoot == 0 && key == 0, "json builder already has a root");
+         myRoot = item;
+         return item;
+      }
+      Level& level = myStack.back();
+      XASSERT(((level.container->type & sJSON_TypeMask) == sJSON_Object) == (key != 0),
+              "json builder: map members need a key, array elements must not have one");
+#ifdef CHANGE_TRACKING_ENABLED
+      item->parent = level.container;
+#endif
+      if (key) {
+         item->nameHash = key->hash();
+#ifdef WRITE_SUPPORT_ENABLED
+         item->nameString = ::sJSONarenaStrdup(myArena, key->name());
+#endif
+      }
+      if (level.last) {
+         level.last->next = item;
+         item->prev = level.last;
+      } else
+         level.container->child = item;
+      level.last = item;
+      return item;
+   }
+
+   Builder& open(::sJSON *container) {
+      Level level = { container, 0 };
+      myStack.push_back(level);
+      return *this;
+   }
+
+   Builder& close(int type) {
+      XASSERT(!myStack.empty() && (myStack.back().container->type & sJSON_TypeMask) == type,
+              "json builder end does not match begin");
+      myStack.pop_back();
+      return *this;
+   }
+
+   static void setNumber(::sJSON *item, double number) {
+      item->valueDouble = number;
+      item->valueInt = (int)number;
+   }
+
+   void setString(::sJSON *item, const char *string) {
+      item->valueString = ::sJSONarenaStrdup(myArena, string);
+      XASSERT(item->valueString != 0, "json builder out of memory");
+   }
+};
+
 //    // Forward declared.
 //    std::ostream& operator<< (std::ostream& stream, const Any& value);
 
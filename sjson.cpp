@@ -31,13 +31,33 @@
 #include <limits.h>
 #include <ctype.h>
 #include "sjson.h"
+#include "sjsoncpu.h"
+
+#if defined(WRITE_SUPPORT_ENABLED) && defined(THREAD_SUPPORT_ENABLED)
+   #include <atomic>
+   #include <thread>
+#endif
+#ifdef CHANGE_TRACKING_ENABLED
+   #include <atomic>
+   #include <new>
+   #ifdef THREAD_SUPPORT_ENABLED
+      #include <mutex>
+   #endif
+#endif
 
 /* sjson: - no {} needed around the whole file
           - "=" is allowed instead of ":"
           - quotes around the key are optional
           - commas after values are optional */
 
-static const char *ep;
+#ifdef THREAD_SUPPORT_ENABLED
+   #define SJSON_THREAD_LOCAL thread_local   /* parses may run on several threads at once */
+#else
+   #define SJSON_THREAD_LOCAL
+#endif
+
+static SJSON_THREAD_LOCAL const char *ep;
+static SJSON_THREAD_LOCAL sJSON_ParseOptions parse_options;    /* options of the running parse */
 
 const char *sJSONgetErrorPtr() {return ep;}
 
@@ -68,6 +88,13 @@ static char* sJSON_strdup(const char* str) {
    return copy;
 }
 
+void *sJSONmalloc(size_t sz) {
+   return sJSON_malloc(sz);
+}
+void sJSONfree(void *ptr) {
+   sJSON_free(ptr);
+}
+
 void sJSONinitHooks(sJSON_Hooks* hooks) {
    if (!hooks) { /* Reset hooks */
      sJSON_malloc = malloc;
@@ -87,20 +114,796 @@ static sJSON *sJSON_New_Item() {
 	return node;
 }
 
+/* Link item to its container, only kept for change tracking. */
+static void set_parent(sJSON *item, sJSON *parent) {
+#ifdef CHANGE_TRACKING_ENABLED
+   item->parent=parent;
+#else
+   (void)item;
+   (void)parent;
+#endif
+}
+
+/* Flag item as modified, up to the root, so printing knows which cached container texts are stale.
+   A dirty container always has dirty ancestors, which lets the walk stop at the first one. Without
+   change tracking there are no flags to keep (type stays comparable to the sJSON_ type values);
+   a scalar only loses its span, so its parsed text isn't copied anymore. Containers keep theirs
+   for sJSONreparse. */
+static void mark_dirty(sJSON *item) {
+#ifdef CHANGE_TRACKING_ENABLED
+   item->type|=sJSON_IsDirty;
+   for (item=item->parent;item && !(item->type&sJSON_IsDirty);item=item->parent)
+      item->type|=sJSON_IsDirty;
+#else
+   int type=item->type&sJSON_TypeMask;
+   if (type!=sJSON_Array && type!=sJSON_Object)
+      item->type&=~sJSON_HasSpan;
+#endif
+}
+
+#ifdef CHANGE_TRACKING_ENABLED
+/* Observed trees: their roots and the rings receiving their change records. */
+#define SJSON_MAX_OBSERVED 16
+
+struct sJSON_ChangeRing {
+   sJSON_Change *records;
+   size_t mask;
+   std::atomic<size_t> head, tail;  /* next record to write / to read */
+   std::atomic<size_t> dropped;
+};
+
+static struct {
+   sJSON *root;
+   sJSON_ChangeRing *ring;
+} observed[SJSON_MAX_OBSERVED];
+static std::atomic<int> numObserved(0);   /* also read without the lock, to skip the search while nothing is observed */
+
+/* The table is shared by all threads: trees may be observed, edited and deleted on several. */
+#ifdef THREAD_SUPPORT_ENABLED
+static std::mutex observedLock;
+#define SJSON_OBSERVED_LOCK() std::lock_guard<std::mutex> observedGuard(observedLock)
+#else
+#define SJSON_OBSERVED_LOCK()
+#endif
+
+/* Stop observing entry i, with the lock held. */
+static void unobserve(int i) {
+   int last=numObserved.load(std::memory_order_relaxed)-1;
+   observed[i]=observed[last];
+   numObserved.store(last,std::memory_order_relaxed);
+}
+
+sJSON_ChangeRing *sJSONchangeRingCreate(size_t capacity) {
+   size_t size=16;
+   void *mem=sJSON_malloc(sizeof(sJSON_ChangeRing));
+   sJSON_ChangeRing *ring;
+   if (!mem)
+      return 0;
+   while (size<capacity)
+      size*=2;
+   ring=new (mem) sJSON_ChangeRing;
+   ring->mask=size-1;
+   ring->head.store(0);
+   ring->tail.store(0);
+   ring->dropped.store(0);
+   if (!(ring->records=(sJSON_Change*)sJSON_malloc(size*sizeof(sJSON_Change)))) {
+      sJSONchangeRingDelete(ring);
+      return 0;
+   }
+   return ring;
+}
+
+void sJSONchangeRingDelete(sJSON_ChangeRing *ring) {
+   int i;
+   if (!ring)
+      return;
+   {
+      SJSON_OBSERVED_LOCK();
+      for (i=numObserved.load(std::memory_order_relaxed)-1;i>=0;i--)
+         if (observed[i].ring==ring)
+            unobserve(i);
+   }
+   sJSON_free(ring->records);
+   ring->~sJSON_ChangeRing();
+   sJSON_free(ring);
+}
+
+int sJSONpollChange(sJSON_ChangeRing *ring, sJSON_Change *change) {
+   size_t tail=ring->tail.load(std::memory_order_relaxed);
+   if (tail==ring->head.load(std::memory_order_acquire))
+      return 0;
+   *change=ring->records[tail&ring->mask];
+   ring->tail.store(tail+1,std::memory_order_release);
+   return 1;
+}
+
+size_t sJSONchangesDropped(const sJSON_ChangeRing *ring) {
+   return ring->dropped.load(std::memory_order_relaxed);
+}
+
+/* Keep the ring of a tree whose root was replaced by a copy. */
+static void observe_moved(sJSON *root, sJSON *copy) {
+   SJSON_OBSERVED_LOCK();
+   for (int i=0;i<numObserved.load(std::memory_order_relaxed);i++)
+      if (observed[i].root==root)
+         observed[i].root=copy;
+}
+
+int sJSONobserve(sJSON *root, sJSON_ChangeRing *ring) {
+   SJSON_OBSERVED_LOCK();
+   int count=numObserved.load(std::memory_order_relaxed), i;
+   for (i=0;i<count && observed[i].root!=root;i++)
+      ;
+   if (!ring) {
+      if (i<count)
+         unobserve(i);
+      return 1;
+   }
+   if (i==SJSON_MAX_OBSERVED)
+      return 0;
+   observed[i].root=root;
+   observed[i].ring=ring;
+   if (i==count)
+      numObserved.store(count+1,std::memory_order_relaxed);
+   return 1;
+}
+#endif
+
+/* Report a change to the ring observing the tree, if there is one. parent 0 stands for the
+   container of node. */
+static void notify_change(int kind, sJSON *node, sJSON *parent) {
+#ifdef CHANGE_TRACKING_ENABLED
+   sJSON *root=node;
+   uint32_t pathHash=node->nameHash;
+   sJSON_ChangeRing *ring=0;
+   size_t head;
+   int i;
+   if (!numObserved.load(std::memory_order_relaxed))
+      return;
+   if (!parent)
+      parent=node->parent;
+   for (sJSON *c=parent;c;c=c->parent) {
+      pathHash=pathHash*0x9e3779b1u^c->nameHash;
+      root=c;
+   }
+   {
+      SJSON_OBSERVED_LOCK();
+      for (i=0;i<numObserved.load(std::memory_order_relaxed) && !ring;i++)
+         if (observed[i].root==root)
+            ring=observed[i].ring;
+   }
+   if (!ring)
+      return;
+   head=ring->head.load(std::memory_order_relaxed);
+   if (head-ring->tail.load(std::memory_order_acquire)>ring->mask) {
+      ring->dropped.fetch_add(1,std::memory_order_relaxed);
+      return;
+   }
+   sJSON_Change *change=ring->records+(head&ring->mask);
+   change->node=node;
+   change->parent=parent;
+   change->kind=kind;
+   change->nameHash=node->nameHash;
+   change->pathHash=pathHash;
+   ring->head.store(head+1,std::memory_order_release);
+#else
+   (void)kind;
+   (void)node;
+   (void)parent;
+#endif
+}
+
+/* Arena allocator: items and strings are carved out of big blocks and released all at once. */
+#define SJSON_ARENA_DEFAULT_BLOCKSIZE (16*1024)
+#define SJSON_ARENA_ALIGN(sz) (((sz)+7)&~(size_t)7)
+
+typedef struct sJSON_ArenaBlock {
+   struct sJSON_ArenaBlock *next;
+   size_t size, used;
+} sJSON_ArenaBlock;
+
+struct sJSON_Arena {
+   sJSON_ArenaBlock *blocks;     /* newest block first */
+   size_t blockSize;
+};
+
+static sJSON_ArenaBlock *arena_new_block(size_t size) {
+   sJSON_ArenaBlock *block=(sJSON_ArenaBlock*)sJSON_malloc(SJSON_ARENA_ALIGN(sizeof(sJSON_ArenaBlock))+size);
+   if (!block)
+      return 0;
+   block->next=0;
+   block->size=size;
+   block->used=0;
+   return block;
+}
+
+sJSON_Arena *sJSONarenaCreate(size_t blockSize) {
+   sJSON_Arena *arena=(sJSON_Arena*)sJSON_malloc(sizeof(sJSON_Arena));
+   if (!arena)
+      return 0;
+   arena->blocks=0;
+   arena->blockSize=blockSize?SJSON_ARENA_ALIGN(blockSize):SJSON_ARENA_DEFAULT_BLOCKSIZE;
+   return arena;
+}
+
+void *sJSONarenaAlloc(sJSON_Arena *arena, size_t sz) {
+   sJSON_ArenaBlock *block=arena->blocks;
+   sz=SJSON_ARENA_ALIGN(sz);
+   if (!block || block->used+sz>block->size) {
+      if (sz>arena->blockSize/4) {  /* big allocations get a block of their own behind the current one */
+         sJSON_ArenaBlock *big=arena_new_block(sz);
+         if (!big)
+            return 0;
+         big->used=sz;
+         if (block) {
+            big->next=block->next;
+            block->next=big;
+         } else
+            arena->blocks=big;
+         return (char*)big+SJSON_ARENA_ALIGN(sizeof(sJSON_ArenaBlock));
+      }
+      if (!(block=arena_new_block(arena->blockSize)))
+         return 0;
+      block->next=arena->blocks;
+      arena->blocks=block;
+   }
+   void *ptr=(char*)block+SJSON_ARENA_ALIGN(sizeof(sJSON_ArenaBlock))+block->used;
+   block->used+=sz;
+   return ptr;
+}
+
+/* Release everything but one regular block, which is kept for reuse. */
+void sJSONarenaReset(sJSON_Arena *arena) {
+   sJSON_ArenaBlock *keep=0, *block=arena->blocks;
+   while (block) {
+      sJSON_ArenaBlock *next=block->next;
+      if (!keep && block->size==arena->blockSize) {
+         keep=block;
+         keep->used=0;
+         keep->next=0;
+      } else
+         sJSON_free(block);
+      block=next;
+   }
+   arena->blocks=keep;
+}
+
+void sJSONarenaDelete(sJSON_Arena *arena) {
+   if (!arena)
+      return;
+   sJSONarenaReset(arena);
+   if (arena->blocks)
+      sJSON_free(arena->blocks);
+   sJSON_free(arena);
+}
+
+sJSON *sJSONarenaNewItem(sJSON_Arena *arena) {
+   sJSON *node=(sJSON*)sJSONarenaAlloc(arena,sizeof(sJSON));
+   if (node) {
+      memset(node,0,sizeof(sJSON));
+      node->type=sJSON_IsArena;
+   }
+   return node;
+}
+
+char *sJSONarenaStrdup(sJSON_Arena *arena, const char *str) {
+   size_t len=strlen(str)+1;
+   char *copy=(char*)sJSONarenaAlloc(arena,len);
+   if (copy)
+      memcpy(copy,str,len);
+   return copy;
+}
+
+/* Items and strings of the running parse, from the arena of its options if it has one. */
+static sJSON *parse_new_item() {
+   return parse_options.arena?sJSONarenaNewItem(parse_options.arena):sJSON_New_Item();
+}
+
+static char *parse_alloc(size_t size) {
+   return (char*)(parse_options.arena?sJSONarenaAlloc(parse_options.arena,size):sJSON_malloc(size));
+}
+
+/* Release a failed parse. Items of an arena are left to it, not all of them are flagged yet. */
+static void parse_failed(sJSON *c) {
+   if (!parse_options.arena)
+      sJSONdelete(c);
+}
+
+/* Interned strings: one copy per distinct string, looked up by hash and length. The strings live
+   in the table's arena. */
+typedef struct sJSON_StringEntry {
+   const char *str;           /* 0 for a free slot */
+   uint32_t hash, length;
+} sJSON_StringEntry;
+
+struct sJSON_StringTable {
+   sJSON_StringEntry *entries;
+   size_t mask, count;
+   sJSON_Arena *arena;
+};
+
+sJSON_StringTable *sJSONstringTableCreate() {
+   sJSON_StringTable *table=(sJSON_StringTable*)sJSON_malloc(sizeof(sJSON_StringTable));
+   if (!table)
+      return 0;
+   table->count=0;
+   table->mask=255;
+   table->arena=sJSONarenaCreate(0);
+   table->entries=(sJSON_StringEntry*)sJSON_malloc((table->mask+1)*sizeof(sJSON_StringEntry));
+   if (!table->entries || !table->arena) {
+      sJSON_free(table->entries);
+      sJSONarenaDelete(table->arena);
+      sJSON_free(table);
+      return 0;
+   }
+   memset(table->entries,0,(table->mask+1)*sizeof(sJSON_StringEntry));
+   return table;
+}
+
+void sJSONstringTableDelete(sJSON_StringTable *table) {
+   if (!table)
+      return;
+   sJSON_free(table->entries);
+   sJSONarenaDelete(table->arena);
+   sJSON_free(table);
+}
+
+static sJSON_StringEntry *string_slot(sJSON_StringEntry *entries, size_t mask, const char *str, uint32_t length, uint32_t hash) {
+   sJSON_StringEntry *e=entries+(hash&mask);
+   while (e->str && (e->hash!=hash || e->length!=length || memcmp(e->str,str,length)))
+      e=entries+((e-entries+1)&mask);
+   return e;
+}
+
+/* The table's copy of the length chars at str, 0 on memory fail. */
+static const char *intern_string(sJSON_StringTable *table, const char *str, size_t length) {
+   uint32_t hash=eastl::murmurHash((const uint8_t*)str,(uint32_t)length);
+   sJSON_StringEntry *e=string_slot(table->entries,table->mask,str,(uint32_t)length,hash);
+   char *copy;
+   if (e->str)
+      return e->str;
+   if ((table->count+1)*2>table->mask+1) {   /* keep the load below one half */
+      size_t i, newMask=table->mask*2+1;
+      sJSON_StringEntry *entries=(sJSON_StringEntry*)sJSON_malloc((newMask+1)*sizeof(sJSON_StringEntry));
+      if (!entries)
+         return 0;
+      memset(entries,0,(newMask+1)*sizeof(sJSON_StringEntry));
+      for (i=0;i<=table->mask;i++)
+         if (table->entries[i].str)
+            *string_slot(entries,newMask,table->entries[i].str,table->entries[i].length,table->entries[i].hash)=table->entries[i];
+      sJSON_free(table->entries);
+      table->entries=entries;
+      table->mask=newMask;
+      e=string_slot(table->entries,table->mask,str,(uint32_t)length,hash);
+   }
+   if (!(copy=(char*)sJSONarenaAlloc(table->arena,length+1)))
+      return 0;
+   memcpy(copy,str,length);
+   copy[length]=0;
+   e->str=copy;
+   e->hash=hash;
+   e->length=(uint32_t)length;
+   table->count++;
+   return copy;
+}
+
+const char *sJSONstringTableIntern(sJSON_StringTable *table, const char *str) {
+   return intern_string(table,str,strlen(str));
+}
+
+size_t sJSONstringTableCount(const sJSON_StringTable *table) {
+   return table->count;
+}
+
+/* Object shapes. A shape holds the key hashes of an object in order and a probe map from hash to
+   slot; the object holds its children in slot order. Shapes live in the table's arena. */
+#define SJSON_SHAPE_MIN_KEYS 4       /* smaller objects are scanned as fast as they are mapped */
+#define SJSON_SHAPE_MAX_KEYS 32767
+#define SJSON_SHAPE_NO_SLOT 0xffff
+
+typedef struct sJSON_Shape {
+   uint32_t count, mask;
+   uint32_t *hashes;       /* count key hashes */
+   uint16_t *map;          /* mask+1 slots, SJSON_SHAPE_NO_SLOT when free */
+} sJSON_Shape;
+
+struct sJSON_Slots {
+   sJSON_Shape *shape;
+   sJSON *items[1];        /* shape->count children */
+};
+
+struct sJSON_ShapeTable {
+   sJSON_Shape **shapes;   /* open addressing on the hash of the key sequence */
+   uint32_t *keys;
+   size_t mask, count;
+   sJSON_Arena *arena;
+};
+
+sJSON_ShapeTable *sJSONshapeTableCreate() {
+   sJSON_ShapeTable *table=(sJSON_ShapeTable*)sJSON_malloc(sizeof(sJSON_ShapeTable));
+   if (!table)
+      return 0;
+   table->count=0;
+   table->mask=63;
+   table->arena=sJSONarenaCreate(0);
+   table->shapes=(sJSON_Shape**)sJSON_malloc((table->mask+1)*sizeof(sJSON_Shape*));
+   table->keys=(uint32_t*)sJSON_malloc((table->mask+1)*sizeof(uint32_t));
+   if (!table->shapes || !table->keys || !table->arena) {
+      sJSONshapeTableDelete(table);
+      return 0;
+   }
+   memset(table->shapes,0,(table->mask+1)*sizeof(sJSON_Shape*));
+   return table;
+}
+
+void sJSONshapeTableDelete(sJSON_ShapeTable *table) {
+   if (!table)
+      return;
+   sJSON_free(table->shapes);
+   sJSON_free(table->keys);
+   sJSONarenaDelete(table->arena);
+   sJSON_free(table);
+}
+
+size_t sJSONshapeTableCount(const sJSON_ShapeTable *table) {
+   return table->count;
+}
+
+/* Slot of the first key with the hash, -1 if there is none. */
+static int shape_slot(const sJSON_Shape *shape, uint32_t hash) {
+   uint32_t i=hash&shape->mask;
+   while (shape->map[i]!=SJSON_SHAPE_NO_SLOT) {
+      if (shape->hashes[shape->map[i]]==hash)
+         return shape->map[i];
+      i=(i+1)&shape->mask;
+   }
+   return -1;
+}
+
+static sJSON_Shape *new_shape(sJSON_Arena *arena, const uint32_t *hashes, uint32_t count) {
+   sJSON_Shape *shape=(sJSON_Shape*)sJSONarenaAlloc(arena,sizeof(sJSON_Shape));
+   uint32_t i, size=8;
+   while (size<count*2)
+      size*=2;
+   if (!shape)
+      return 0;
+   shape->count=count;
+   shape->mask=size-1;
+   shape->hashes=(uint32_t*)sJSONarenaAlloc(arena,count*sizeof(uint32_t));
+   shape->map=(uint16_t*)sJSONarenaAlloc(arena,size*sizeof(uint16_t));
+   if (!shape->hashes || !shape->map)
+      return 0;
+   memcpy(shape->hashes,hashes,count*sizeof(uint32_t));
+   memset(shape->map,0xff,size*sizeof(uint16_t));
+   for (i=0;i<count;i++)
+      if (shape_slot(shape,hashes[i])<0) {    /* the first of duplicate keys wins, as in the chain */
+         uint32_t j=hashes[i]&shape->mask;
+         while (shape->map[j]!=SJSON_SHAPE_NO_SLOT)
+            j=(j+1)&shape->mask;
+         shape->map[j]=(uint16_t)i;
+      }
+   return shape;
+}
+
+static size_t shape_entry(sJSON_Shape **shapes, const uint32_t *keys, size_t mask, uint32_t key, const uint32_t *hashes, uint32_t count) {
+   size_t i=key&mask;
+   while (shapes[i] && (keys[i]!=key || shapes[i]->count!=count || memcmp(shapes[i]->hashes,hashes,count*sizeof(uint32_t))))
+      i=(i+1)&mask;
+   return i;
+}
+
+/* The shape of the key sequence, made on first use. */
+static sJSON_Shape *find_shape(sJSON_ShapeTable *table, const uint32_t *hashes, uint32_t count) {
+   uint32_t key=eastl::murmurHash((const uint8_t*)hashes,count*sizeof(uint32_t));
+   size_t i=shape_entry(table->shapes,table->keys,table->mask,key,hashes,count);
+   if (table->shapes[i])
+      return table->shapes[i];
+   if ((table->count+1)*2>table->mask+1) {   /* keep the load below one half */
+      size_t j, newMask=table->mask*2+1;
+      sJSON_Shape **shapes=(sJSON_Shape**)sJSON_malloc((newMask+1)*sizeof(sJSON_Shape*));
+      uint32_t *keys=(uint32_t*)sJSON_malloc((newMask+1)*sizeof(uint32_t));
+      if (!shapes || !keys) {
+         sJSON_free(shapes);
+         sJSON_free(keys);
+         return 0;
+      }
+      memset(shapes,0,(newMask+1)*sizeof(sJSON_Shape*));
+      for (j=0;j<=table->mask;j++)
+         if (table->shapes[j]) {
+            size_t k=shape_entry(shapes,keys,newMask,table->keys[j],table->shapes[j]->hashes,table->shapes[j]->count);
+            shapes[k]=table->shapes[j];
+            keys[k]=table->keys[j];
+         }
+      sJSON_free(table->shapes);
+      sJSON_free(table->keys);
+      table->shapes=shapes;
+      table->keys=keys;
+      table->mask=newMask;
+      i=shape_entry(table->shapes,table->keys,table->mask,key,hashes,count);
+   }
+   if (!(table->shapes[i]=new_shape(table->arena,hashes,count)))
+      return 0;
+   table->keys[i]=key;
+   table->count++;
+   return table->shapes[i];
+}
+
+int sJSONshapeObject(sJSON_ShapeTable *table, sJSON *object) {
+   uint32_t local[64], *hashes=local;
+   uint32_t i, count=0;
+   sJSON *c;
+   sJSON_Shape *shape=0;
+   sJSON_Slots *slots;
+   if ((object->type&(sJSON_TypeMask|sJSON_IsReference))!=sJSON_Object || (object->type&sJSON_HasShape))
+      return (object->type&sJSON_HasShape)!=0;
+   for (c=object->child;c && count<=SJSON_SHAPE_MAX_KEYS;c=c->next)
+      count++;
+   if (count<SJSON_SHAPE_MIN_KEYS || count>SJSON_SHAPE_MAX_KEYS)
+      return 0;
+   if (count>64 && !(hashes=(uint32_t*)sJSON_malloc(count*sizeof(uint32_t))))
+      return 0;
+   for (c=object->child,i=0;c;c=c->next)
+      hashes[i++]=c->nameHash;
+   shape=find_shape(table,hashes,count);
+   if (hashes!=local)
+      sJSON_free(hashes);
+   if (!shape || !(slots=(sJSON_Slots*)sJSON_malloc(sizeof(sJSON_Slots)+(count-1)*sizeof(sJSON*))))
+      return 0;
+   slots->shape=shape;
+   for (c=object->child,i=0;c;c=c->next)
+      slots->items[i++]=c;
+   object->slots=slots;
+   object->type|=sJSON_HasShape;
+   return 1;
+}
+
+/* Back to scanning the chain, the children of the object are about to change. */
+static void drop_shape(sJSON *object) {
+   if (object->type&sJSON_HasShape) {
+      sJSON_free(object->slots);
+      object->slots=0;
+      object->type&=~sJSON_HasShape;
+   }
+}
+
+/* Source spans, kept out of the items in an open addressing table keyed by item address. */
+typedef struct sJSON_SpanEntry {
+   const sJSON *item;         /* 0 for a free slot */
+   uint32_t offset, length;
+} sJSON_SpanEntry;
+
+struct sJSON_SpanTable {
+   const char *source;        /* text of the last parse filling the table */
+   sJSON_SpanEntry *entries;
+   size_t mask, count;
+   uint32_t *lines;           /* offsets of the line starts of source, built on demand */
+   size_t numLines;           /* 0 until built */
+};
+
+/* The key of a member has its span under the address of its nameHash. */
+#define SPAN_KEY(item) ((const sJSON*)&(item)->nameHash)
+
+static size_t span_slot(const sJSON_SpanTable *table, const sJSON *item) {
+   size_t h=(size_t)item;
+   h=(h>>4)^(h>>17);
+   return (h*0x9E3779B1u)&table->mask;
+}
+
+sJSON_SpanTable *sJSONspanTableCreate() {
+   sJSON_SpanTable *table=(sJSON_SpanTable*)sJSON_malloc(sizeof(sJSON_SpanTable));
+   if (!table)
+      return 0;
+   table->source=0;
+   table->count=0;
+   table->lines=0;
+   table->numLines=0;
+   table->mask=255;
+   table->entries=(sJSON_SpanEntry*)sJSON_malloc((table->mask+1)*sizeof(sJSON_SpanEntry));
+   if (!table->entries) {
+      sJSON_free(table);
+      return 0;
+   }
+   memset(table->entries,0,(table->mask+1)*sizeof(sJSON_SpanEntry));
+   return table;
+}
+
+void sJSONspanTableDelete(sJSON_SpanTable *table) {
+   if (!table)
+      return;
+   sJSON_free(table->entries);
+   sJSON_free(table->lines);
+   sJSON_free(table);
+}
+
+/* The text the spans are relative to changed, the line starts have to be found again. */
+static void span_set_source(sJSON_SpanTable *table, const char *source) {
+   table->source=source;
+   table->numLines=0;
+}
+
+static int span_insert(sJSON_SpanTable *table, const sJSON *item, size_t offset, size_t length);
+
+/* Grow the table until count more entries keep the load below one half. */
+static int span_reserve(sJSON_SpanTable *table, size_t count) {
+   while ((table->count+count)*2>table->mask+1) {
+      sJSON_SpanEntry *old=table->entries;
+      size_t i, oldSize=table->mask+1;
+      sJSON_SpanEntry *entries=(sJSON_SpanEntry*)sJSON_malloc(oldSize*2*sizeof(sJSON_SpanEntry));
+      if (!entries)
+         return 0;
+      memset(entries,0,oldSize*2*sizeof(sJSON_SpanEntry));
+      table->entries=entries;
+      table->mask=oldSize*2-1;
+      table->count=0;
+      for (i=0;i<oldSize;i++)
+         if (old[i].item)
+            span_insert(table,old[i].item,old[i].offset,old[i].length);
+      sJSON_free(old);
+   }
+   return 1;
+}
+
+static int span_insert(sJSON_SpanTable *table, const sJSON *item, size_t offset, size_t length) {
+   sJSON_SpanEntry *e;
+   if (!span_reserve(table,1))
+      return 0;
+   e=table->entries+span_slot(table,item);
+   while (e->item && e->item!=item)
+      e=table->entries+((e-table->entries+1)&table->mask);
+   if (!e->item)
+      table->count++;
+   e->item=item;
+   e->offset=(uint32_t)offset;
+   e->length=(uint32_t)length;
+   return 1;
+}
+
+static const sJSON_SpanEntry *span_find(const sJSON_SpanTable *table, const sJSON *item) {
+   const sJSON_SpanEntry *e=table->entries+span_slot(table,item);
+   while (e->item) {
+      if (e->item==item)
+         return e;
+      e=table->entries+((e-table->entries+1)&table->mask);
+   }
+   return 0;
+}
+
+int sJSONgetSourceSpan(const sJSON_SpanTable *table, const sJSON *item, size_t *offset, size_t *length) {
+   const sJSON_SpanEntry *e=span_find(table,item);
+   if (!e)
+      return 0;
+   *offset=e->offset;
+   *length=e->length;
+   return 1;
+}
+
+int sJSONgetKeySpan(const sJSON_SpanTable *table, const sJSON *item, size_t *offset, size_t *length) {
+   return sJSONgetSourceSpan(table,SPAN_KEY(item),offset,length);
+}
+
+const char *sJSONgetSpanSource(const sJSON_SpanTable *table) {
+   return table->source;
+}
+
+int sJSONgetLineColumn(sJSON_SpanTable *table, size_t offset, size_t *line, size_t *column) {
+   size_t low=0, high;
+   if (!table->source)
+      return 0;
+   if (!table->numLines) {
+      size_t count=1, size=64;
+      const char *c=table->source;
+      uint32_t *lines=(uint32_t*)sJSON_malloc(size*sizeof(uint32_t));
+      if (!lines)
+         return 0;
+      lines[0]=0;
+      while ((c=strchr(c,'\n'))) {
+         if (count==size) {
+            uint32_t *grown=(uint32_t*)sJSON_malloc(size*2*sizeof(uint32_t));
+            if (!grown) {
+               sJSON_free(lines);
+               return 0;
+            }
+            memcpy(grown,lines,size*sizeof(uint32_t));
+            sJSON_free(lines);
+            lines=grown;
+            size*=2;
+         }
+         lines[count++]=(uint32_t)(++c-table->source);
+      }
+      sJSON_free(table->lines);
+      table->lines=lines;
+      table->numLines=count;
+   }
+   high=table->numLines;
+   while (high-low>1) {    /* the last line starting at or before offset */
+      size_t mid=(low+high)/2;
+      if (table->lines[mid]<=offset)
+         low=mid;
+      else
+         high=mid;
+   }
+   *line=low+1;
+   *column=offset-table->lines[low]+1;
+   return 1;
+}
+
+/* Remove the span of item, moving later entries of its probe run back into the gap. */
+static void span_erase(sJSON_SpanTable *table, const sJSON *item) {
+   size_t i=span_slot(table,item), j, home;
+   while (table->entries[i].item!=item) {
+      if (!table->entries[i].item)
+         return;
+      i=(i+1)&table->mask;
+   }
+   table->count--;
+   for (j=i;;) {
+      table->entries[i].item=0;
+      do {
+         j=(j+1)&table->mask;
+         if (!table->entries[j].item)
+            return;
+         home=span_slot(table,table->entries[j].item);
+      } while (i<=j?(i<home && home<=j):(i<home || home<=j));    /* entry j can stay */
+      table->entries[i]=table->entries[j];
+      i=j;
+   }
+}
+
+/* Remember where item came from, start..end being its text in the source. */
+static int record_span(sJSON *item, const char *start, const char *end) {
+   sJSON_SpanTable *spans=parse_options.spans;
+   if (!spans || !end)
+      return 1;
+   item->type|=sJSON_HasSpan;
+   return span_insert(spans,item,start-spans->source,end-start);
+}
+
 /* Delete a sJSON structure. */
+/* Whether sJSONdelete frees the strings of item. Those of arena items belong to the arena, unless
+   the API replaced them. */
+static int frees_value(const sJSON *item) {
+   return item->valueString && !(item->type&(sJSON_IsReference|sJSON_IsLazy|sJSON_IsInterned))
+      && (!(item->type&sJSON_IsArena) || (item->type&sJSON_OwnsValue));
+}
+#ifdef WRITE_SUPPORT_ENABLED
+static int frees_name(const sJSON *item) {
+   return item->nameString && (!(item->type&sJSON_IsArena) || (item->type&sJSON_OwnsName));
+}
+
+/* Give item the malloc'ed name, releasing the one it had. */
+static void set_name(sJSON *item, char *name) {
+   if (frees_name(item))
+      sJSON_free(item->nameString);
+   item->nameString=name;
+   if (item->type&sJSON_IsArena)
+      item->type|=sJSON_OwnsName;
+}
+#endif
+
 void sJSONdelete(sJSON *c) {
 	sJSON *next;
    while (c) {
 		next=c->next;
       if (!(c->type&sJSON_IsReference) && c->child)
          sJSONdelete(c->child);
-      if (!(c->type&sJSON_IsReference) && c->valueString)
+#ifdef CHANGE_TRACKING_ENABLED
+      if (c->printCache)
+         sJSON_free(c->printCache);
+      if (numObserved.load(std::memory_order_relaxed) && !c->parent)
+         sJSONobserve(c,0);
+#endif
+      drop_shape(c);
+      if (frees_value(c))
          sJSON_free(c->valueString);
 #ifdef WRITE_SUPPORT_ENABLED
-      if (c->nameString)
+      if (frees_name(c))
          sJSON_free(c->nameString);
 #endif
-		sJSON_free(c);
+      if (!(c->type&sJSON_IsArena)) {  /* arena items are released with their arena */
+         sJSON_free(c);
+      } else if (c->type&sJSON_IsCompact) {
+         sJSON_free(c);    /* the block */
+      }
 		c=next;
 	}
 }
@@ -128,33 +931,186 @@ static const char *parse_number(sJSON *item, const char *num) {
 	return num;
 }
 
-/* Render the number nicely from the given item into a string. */
-static char *print_number(sJSON *item) {
-	char *str;
-   double d=item->valueDouble;
-   if (fabs(((double)item->valueInt)-d)<=DBL_EPSILON && d<=INT_MAX && d>=INT_MIN) {
-		str=(char*)sJSON_malloc(21);	/* 2^64+1 can be represented in 21 chars. */
-      if (str)
-         sprintf(str,"%d",item->valueInt);
-   } else {
-		str=(char*)sJSON_malloc(64);	/* This is a nice tradeoff. */
-      if (str) {
-         if (fabs(floor(d)-d)<=DBL_EPSILON)
-            sprintf(str,"%.0f",d);
-         else if (fabs(d)<1.0e-6 || fabs(d)>1.0e9)
-            sprintf(str,"%e",d);
-         else
-            sprintf(str,"%f",d);
-		}
-	}
-	return str;
+/* Find the end of a number the way parse_number does, without computing it. */
+static const char *skip_number(const char *num) {
+   if (*num=='-') num++;
+   if (*num=='0') num++;
+   if (*num>='1' && *num<='9')	do	num++;	while (*num>='0' && *num<='9');
+   if (*num=='.') {num++;		do	num++; while (*num>='0' && *num<='9');}
+   if (*num=='e' || *num=='E') {
+      num++;if (*num=='+') num++;	else if (*num=='-') num++;
+      while (*num>='0' && *num<='9') num++;
+   }
+   return num;
 }
 
-static const char *parse_string(sJSON *item,const char *str);
+/* Convert a lazily parsed number, its text is still at valueString. */
+static void resolve_number(sJSON *item) {
+   if (item->type&sJSON_IsLazy) {
+      int flags=item->type&~(sJSON_TypeMask|sJSON_IsLazy);
+      parse_number(item,item->valueString);
+      item->valueString=0;
+      item->type|=flags;
+   }
+}
+
+int sJSONgetNumberInt(sJSON *item) {
+   resolve_number(item);
+   return item->valueInt;
+}
+double sJSONgetNumberDouble(sJSON *item) {
+   resolve_number(item);
+   return item->valueDouble;
+}
+
+/* Render the number nicely into str, which needs room for SJSON_NUMBER_MAX chars. */
+#define SJSON_NUMBER_MAX 64
+static int format_number(int i, double d, char *str) {
+   if (fabs(((double)i)-d)<=DBL_EPSILON && d<=INT_MAX && d>=INT_MIN)
+      return snprintf(str,SJSON_NUMBER_MAX,"%d",i);
+   if (fabs(d)>=1.0e17)    /* %.0f would spell out up to 309 digits */
+      return snprintf(str,SJSON_NUMBER_MAX,"%.17g",d);
+   if (fabs(floor(d)-d)<=DBL_EPSILON)
+      return snprintf(str,SJSON_NUMBER_MAX,"%.0f",d);
+   if (fabs(d)<1.0e-6 || fabs(d)>1.0e9)
+      return snprintf(str,SJSON_NUMBER_MAX,"%e",d);
+   return snprintf(str,SJSON_NUMBER_MAX,"%f",d);
+}
+int sJSONformatNumber(double num, char *buffer) {
+   return format_number((num<=INT_MAX && num>=INT_MIN)?(int)num:0,num,buffer);
+}
+
+#ifdef WRITE_SUPPORT_ENABLED
+/* Printer output: one growing text buffer. In segment mode long strings are not copied,
+   they are referenced in place and the buffer only holds the text between them. */
+typedef struct printsegment {
+   const char *ref;           /* referenced text, 0 for a range of the buffer */
+   size_t start, length;
+   sJSON *task;               /* placeholder for a subtree printed separately */
+} printsegment;
+
+typedef struct printbuffer {
+   char *buffer;
+   size_t length, offset;
+   printsegment *segments;    /* 0 unless printing segments */
+   int numSegments, maxSegments;
+   size_t segmentStart;       /* start of the buffer range not yet in a segment */
+   int taskDepth;             /* containers at this depth become task placeholders, 0 for none */
+   const sJSON_SpanTable *spans;  /* print unmodified scalars as they were parsed */
+} printbuffer;
+
+/* Strings at least this long are referenced in place when printing segments. */
+#define SJSON_SEGMENT_MIN_STRING 64
+
+static int printbuffer_init(printbuffer *p, size_t length) {
+   memset(p,0,sizeof(printbuffer));
+   p->buffer=(char*)sJSON_malloc(length);
+   p->length=length;
+   return p->buffer!=0;
+}
+
+/* Make room for needed more chars, returns the write position. */
+static char *ensure(printbuffer *p, size_t needed) {
+   if (p->offset+needed>p->length) {
+      size_t newLength=p->length*2;
+      while (p->offset+needed>newLength)
+         newLength*=2;
+      char *newBuffer=(char*)sJSON_malloc(newLength);
+      if (!newBuffer)
+         return 0;
+      memcpy(newBuffer,p->buffer,p->offset);
+      sJSON_free(p->buffer);
+      p->buffer=newBuffer;
+      p->length=newLength;
+   }
+   return p->buffer+p->offset;
+}
+
+static int print_chars(printbuffer *p, const char *str, size_t len) {
+   char *out=ensure(p,len);
+   if (!out)
+      return 0;
+   memcpy(out,str,len);
+   p->offset+=len;
+   return 1;
+}
+
+static int print_char(printbuffer *p, char c) {
+   char *out=ensure(p,1);
+   if (!out)
+      return 0;
+   *out=c;
+   p->offset++;
+   return 1;
+}
+
+static int print_tabs(printbuffer *p, int depth) {
+   char *out=ensure(p,depth);
+   if (!out)
+      return 0;
+   memset(out,'\t',depth);
+   p->offset+=depth;
+   return 1;
+}
+
+static int add_segment(printbuffer *p, const char *ref, size_t start, size_t length, sJSON *task=0) {
+   if (!length && !task)
+      return 1;
+   if (p->numSegments==p->maxSegments) {
+      int newMax=p->maxSegments?p->maxSegments*2:64;
+      printsegment *newSegments=(printsegment*)sJSON_malloc(newMax*sizeof(printsegment));
+      if (!newSegments)
+         return 0;
+      if (p->segments) {
+         memcpy(newSegments,p->segments,p->numSegments*sizeof(printsegment));
+         sJSON_free(p->segments);
+      }
+      p->segments=newSegments;
+      p->maxSegments=newMax;
+   }
+   printsegment *seg=p->segments+p->numSegments++;
+   seg->ref=ref;
+   seg->start=start;
+   seg->length=length;
+   seg->task=task;
+   return 1;
+}
+
+/* Reference len chars of str in place, closing the pending buffer range first. */
+static int print_reference(printbuffer *p, const char *str, size_t len) {
+   if (!add_segment(p,0,p->segmentStart,p->offset-p->segmentStart) || !add_segment(p,str,0,len))
+      return 0;
+   p->segmentStart=p->offset;
+   return 1;
+}
+
+/* Copy the parsed text of an unmodified scalar, returns -1 if there is none. */
+static int print_verbatim(sJSON *item, printbuffer *p) {
+   const sJSON_SpanEntry *e;
+   if (!p->spans || (item->type&(sJSON_IsDirty|sJSON_HasSpan))!=sJSON_HasSpan || !(e=span_find(p->spans,item)))
+      return -1;
+   return print_chars(p,p->spans->source+e->offset,e->length);
+}
+
+/* Render the number nicely from the given item. */
+static int print_number(sJSON *item, printbuffer *p) {
+   int verbatim=print_verbatim(item,p);
+   if (verbatim>=0)
+      return verbatim;
+   resolve_number(item);
+   char *out=ensure(p,SJSON_NUMBER_MAX);
+   if (!out)
+      return 0;
+   p->offset+=format_number(item->valueInt,item->valueDouble,out);
+   return 1;
+}
+#endif
+
+static const char *parse_string(sJSON *item,const char *str,sJSON_Arena *arena);
 
 static const char *parse_string_or_identifier(sJSON *item,const char *str) {
    if(*str == '\"')
-      return parse_string(item, str);
+      return parse_string(item, str, parse_options.arena);
 
    //parse identifier
    char c = *str;
@@ -168,7 +1124,7 @@ static const char *parse_string_or_identifier(sJSON *item,const char *str) {
          ptr++;
          len++;
       }
-      char *out = (char*)sJSON_malloc(len+1);   /* This is how long we need for the string, roughly. */
+      char *out = parse_alloc(len+1);   /* This is how long we need for the string, roughly. */
       if(!out) return 0;
 
       ptr = str;
@@ -191,9 +1147,19 @@ static const char *parse_string_or_identifier(sJSON *item,const char *str) {
    }
 }
 
-/* Parse the input text into an unescaped cstring, and populate item. */
+/* Parse the key of the member item, remembering its span with sJSON_ParseKeySpans. */
+static const char *parse_key(sJSON *item,const char *str) {
+   sJSON_SpanTable *spans=parse_options.spans;
+   const char *end=parse_string_or_identifier(item,str);
+   if (!spans || !end || !(parse_options.flags&sJSON_ParseKeySpans))
+      return end;
+   return span_insert(spans,SPAN_KEY(item),str-spans->source,end-str)?end:0;
+}
+
+/* Parse the input text into an unescaped cstring, and populate item. The copy comes from arena, or
+   from the heap without one. */
 static const unsigned char firstByteMark[7] = { 0x00, 0x00, 0xC0, 0xE0, 0xF0, 0xF8, 0xFC };
-static const char *parse_string(sJSON *item, const char *str) {
+static const char *parse_string(sJSON *item, const char *str, sJSON_Arena *arena) {
    const char *ptr=str+1;
    char *ptr2;
    char *out;
@@ -204,21 +1170,25 @@ static const char *parse_string(sJSON *item, const char *str) {
       return 0;
    }
 	
-   while (*ptr!='\"' && *ptr && ++len)
-      if (*ptr++ == '\\')
-         ptr++;	/* Skip escaped quotes. */
+   while (*(ptr=sJSONkernels.scanString(ptr))=='\\' && ptr[1])
+      ptr+=2;	/* Skip escaped quotes. */
+   len=(int)(ptr-str-1);
 	
-	out=(char*)sJSON_malloc(len+1);	/* This is how long we need for the string, roughly. */
+	out=(char*)(arena?sJSONarenaAlloc(arena,len+1):sJSON_malloc(len+1));	/* This is how long we need for the string, roughly. */
    if (!out)
       return 0;
 	
    ptr=str+1;
    ptr2=out;
    while (*ptr!='\"' && *ptr) {
-      if (*ptr!='\\')
-         *ptr2++=*ptr++;
-      else {
-			ptr++;
+      if (*ptr!='\\') {
+         const char *run=sJSONkernels.scanString(ptr);
+         memcpy(ptr2,ptr,run-ptr);
+         ptr2+=run-ptr;
+         ptr=run;
+      } else {
+         if (!*++ptr)
+            break;      /* the text ends behind the backslash */
          switch (*ptr) {
 				case 'b': *ptr2++='\b';	break;
 				case 'f': *ptr2++='\f';	break;
@@ -226,7 +1196,10 @@ static const char *parse_string(sJSON *item, const char *str) {
 				case 'r': *ptr2++='\r';	break;
 				case 't': *ptr2++='\t';	break;
 				case 'u':	 /* transcode utf16 to utf8. DOES NOT SUPPORT SURROGATE PAIRS CORRECTLY. */
-					sscanf(ptr+1,"%4x",&uc);	/* get the unicode char. */
+					for (uc=0,len=0;len<4 && isxdigit((unsigned char)ptr[1]);len++) {	/* get the unicode char, up to 4 hex digits. */
+						ptr++;
+						uc=uc*16+((*ptr<='9')?*ptr-'0':(*ptr|32)-'a'+10);
+					}
 					len=3;if (uc<0x80) len=1;else if (uc<0x800) len=2;ptr2+=len;
 					
 					switch (len) {
@@ -234,7 +1207,7 @@ static const char *parse_string(sJSON *item, const char *str) {
 						case 2: *--ptr2 =((uc | 0x80) & 0xBF); uc >>= 6;
 						case 1: *--ptr2 =(uc | firstByteMark[len]);
 					}
-					ptr2+=len;ptr+=4;
+					ptr2+=len;
 					break;
 				default:  *ptr2++=*ptr; break;
 			}
@@ -249,34 +1222,151 @@ static const char *parse_string(sJSON *item, const char *str) {
 	return ptr;
 }
 
-/* Render the cstring provided to an escaped version that can be printed. */
-static char *print_string_ptr(const char *str) {
-   const char *ptr;
+/* Record where the string is instead of copying it: valueString points behind the opening quote,
+   valueInt holds the raw length. Decoding waits for the first access. */
+static const char *parse_string_lazy(sJSON *item, const char *str) {
+   const char *ptr=str+1;
+   int escapes=0;
+   while (*(ptr=sJSONkernels.scanString(ptr))=='\\')
+      if (*++ptr) {
+         escapes=sJSON_HasEscapes;
+         ptr++;
+      }
+   item->valueString=(char*)str+1;
+   item->valueInt=(int)(ptr-str-1);
+   item->type=sJSON_String|sJSON_IsLazy|escapes;
+   if (*ptr=='\"')
+      ptr++;
+   return ptr;
+}
+
+/* Share the value with identical strings through the string table of the parse. Strings without
+   escapes are looked up straight from the source, so repeated ones cost no allocation at all. */
+static const char *parse_string_interned(sJSON *item, const char *str) {
+   sJSON_StringTable *table=parse_options.strings;
+   const char *ptr=str+1, *end;
+   const char *shared;
+   ptr=sJSONkernels.scanString(ptr);
+   if (*ptr=='\\') {        /* decode first, then drop the private copy */
+      if (!(end=parse_string(item,str,parse_options.arena)))
+         return 0;
+      shared=intern_string(table,item->valueString,strlen(item->valueString));
+      if (!parse_options.arena)
+         sJSON_free(item->valueString);
+      item->valueString=0;
+   } else {
+      shared=intern_string(table,str+1,ptr-str-1);
+      end=(*ptr=='\"')?ptr+1:ptr;
+   }
+   if (!shared)
+      return 0;
+   item->valueString=(char*)shared;
+   item->type=sJSON_String|sJSON_IsInterned;
+   return end;
+}
+
+/* Copy out and unescape a lazily parsed string, its opening quote is right before valueString. */
+static int resolve_string(sJSON *item) {
+   if (item->type&sJSON_IsLazy) {
+      int flags=item->type&~(sJSON_TypeMask|sJSON_IsLazy|sJSON_HasEscapes);
+      if (!parse_string(item,item->valueString-1,0))   /* the copy is the item's own, not the arena's */
+         return 0;
+      item->valueInt=0;
+      item->type|=flags;
+   }
+   return 1;
+}
+
+const char *sJSONgetString(sJSON *item) {
+   if (!resolve_string(item))
+      return 0;
+   return item->valueString;
+}
+
+const char *sJSONgetStringView(sJSON *item, size_t *length) {
+   if ((item->type&(sJSON_IsLazy|sJSON_HasEscapes))==sJSON_IsLazy) {
+      *length=item->valueInt;
+      return item->valueString;
+   }
+   if (!resolve_string(item))
+      return 0;
+   *length=item->valueString?strlen(item->valueString):0;
+   return item->valueString;
+}
+
+/* The base64 text of a blob without its padding, 0 if item isn't a string of base64 length. */
+static const char *blob_text(sJSON *item, size_t *len) {
+   const char *text;
+   if ((item->type&sJSON_TypeMask)!=sJSON_String || !(text=sJSONgetStringView(item,len)))
+      return 0;
+   if (*len && !(*len%4) && text[*len-1]=='=')
+      *len-=(text[*len-2]=='=')?2:1;
+   return (*len%4==1)?0:text;
+}
+
+static size_t blob_size(size_t len) {
+   return len/4*3+((len%4)?len%4-1:0);
+}
+
+size_t sJSONgetBlobSize(sJSON *item) {
+   size_t len;
+   if (!blob_text(item,&len))
+      return (size_t)-1;
+   return blob_size(len);
+}
+
+size_t sJSONgetBlob(sJSON *item, void *buffer, size_t size) {
+   size_t len;
+   const char *text=blob_text(item,&len);
+   if (!text || blob_size(len)>size || !sJSONkernels.base64Decode(text,len,(unsigned char*)buffer))
+      return (size_t)-1;
+   return blob_size(len);
+}
+
+void *sJSONarenaGetBlob(sJSON_Arena *arena, sJSON *item, size_t *size) {
+   size_t len;
+   const char *text=blob_text(item,&len);
+   void *data;
+   if (!text || !(data=sJSONarenaAlloc(arena,blob_size(len)+1)))    /* +1, empty blobs get memory too */
+      return 0;
+   if (!sJSONkernels.base64Decode(text,len,(unsigned char*)data))
+      return 0;      /* the memory goes with the arena */
+   *size=blob_size(len);
+   return data;
+}
+
+#ifdef WRITE_SUPPORT_ENABLED
+/* Render the len chars of str to an escaped version that can be printed. */
+static int print_string_len(const char *str, size_t len, printbuffer *p) {
+   const char *ptr, *end=str+len;
    char *ptr2,*out;
-   int len=0;
+   size_t escapes=0;
    unsigned char token;
 	
-   if (!str)
-      return sJSON_strdup("");
-   ptr=str;
-   while ((token=*ptr) && ++len) {
+   for (ptr=str;(ptr=sJSONkernels.scanPlain(ptr,end))<end;ptr++) {
+      token=*ptr;
       if (strchr("\"\\\b\f\n\r\t",token))
-         len++;
+         escapes++;
       else if (token<32)
-         len+=5;
-      ptr++;
+         escapes+=5;
    }
-	
-	out=(char*)sJSON_malloc(len+3);
+
+   if (p->segments && !escapes && len>=SJSON_SEGMENT_MIN_STRING)
+      return print_char(p,'\"') && print_reference(p,str,len) && print_char(p,'\"');
+
+	out=ensure(p,len+escapes+2);
    if (!out)
       return 0;
 
 	ptr2=out;ptr=str;
 	*ptr2++='\"';
-   while (*ptr) {
-      if ((unsigned char)*ptr>31 && *ptr!='\"' && *ptr!='\\')
-         *ptr2++=*ptr++;
-      else {
+   while (ptr<end) {
+      if ((unsigned char)*ptr>31 && *ptr!='\"' && *ptr!='\\') {
+         const char *run=sJSONkernels.scanPlain(ptr,end);
+         memcpy(ptr2,ptr,run-ptr);
+         ptr2+=run-ptr;
+         ptr=run;
+      } else {
 			*ptr2++='\\';
          switch (token=*ptr++) {
 				case '\\':	*ptr2++='\\';	break;
@@ -291,22 +1381,38 @@ static char *print_string_ptr(const char *str) {
 		}
 	}
    *ptr2++='\"';
-   *ptr2++=0;
-	return out;
+   p->offset=ptr2-p->buffer;
+	return 1;
+}
+/* Render the cstring provided to an escaped version that can be printed. No string, e.g. a lazy
+   one that failed to decode, fails the print rather than leaving a gap in the text. */
+static int print_string_ptr(const char *str, printbuffer *p) {
+   if (!str)
+      return 0;
+   return print_string_len(str,strlen(str),p);
 }
 /* Invote print_string_ptr (which is useful) on an item. */
-static char *print_string(sJSON *item)	{
-   return print_string_ptr(item->valueString);
+static int print_string(sJSON *item, printbuffer *p)	{
+   int verbatim=print_verbatim(item,p);
+   if (verbatim>=0)
+      return verbatim;
+   if ((item->type&(sJSON_IsLazy|sJSON_HasEscapes))==sJSON_IsLazy)
+      return print_string_len(item->valueString,item->valueInt,p);
+   return print_string_ptr(sJSONgetString(item),p);
 }
+#endif
 
 /* Predeclare these prototypes. */
 static const char *parse_value(sJSON *item,const char *value);
 static const char *parse_array(sJSON *item,const char *value);
 static const char *parse_object(sJSON *item,const char *value);
 #ifdef WRITE_SUPPORT_ENABLED
-   static char *print_value(sJSON *item,int depth,int fmt);
-   static char *print_array(sJSON *item,int depth,int fmt);
-   static char *print_object(sJSON *item,int depth,int fmt);
+   static int print_value(sJSON *item,int depth,int fmt,printbuffer *p);
+   static int print_array(sJSON *item,int depth,int fmt,printbuffer *p);
+   static int print_object(sJSON *item,int depth,int fmt,printbuffer *p);
+#ifdef CHANGE_TRACKING_ENABLED
+   static int print_cached(sJSON *item,int depth,int fmt,printbuffer *p);
+#endif
 #endif
 
 /* Utility to jump whitespace and cr/lf */
@@ -316,7 +1422,7 @@ static const char *skip(const char *in) {
       checkAgain = false;
       while (in && *in && (unsigned char)*in<=32)
          ++in;
-      if(*in && (*in == '/')) {
+      if(in && *in == '/') {     /* in is 0 after a failed parse */
          if(*(in+1) && (*(in+1) == '/')) {
             //skip comment till end of line..
             while(*in && ((*in != 10 && *in != 13)))
@@ -329,7 +1435,9 @@ static const char *skip(const char *in) {
          find_next:
             while(*in && (*in != '*'))
                ++in;
-            if(*(in+1) && *(in+1) != '/') {
+            if (!*in || !*(in+1))
+               return in+(*in!=0);     /* unterminated, stop at the end */
+            if(*(in+1) != '/') {
                ++in;             //skip *
                goto find_next;
             }
@@ -343,85 +1451,483 @@ static const char *skip(const char *in) {
 
 /* Parse an object - create a new root, and populate. */
 sJSON *sJSONparse(const char *value) {
+   return sJSONparseWithOptions(value,0);
+}
+
+static void begin_parse(const char *value, const sJSON_ParseOptions *options) {
 	ep=0;
-	sJSON *c=sJSON_New_Item();
+   if (options)
+      parse_options=*options;
+   else
+      memset(&parse_options,0,sizeof(parse_options));
+   if (parse_options.spans)
+      span_set_source(parse_options.spans,value);
+   if (parse_options.arena) {    /* nothing may be malloc'ed behind the arena's back */
+      parse_options.flags&=~sJSON_ParseLazyStrings;
+      parse_options.shapes=0;
+   }
+}
+
+sJSON *sJSONparseValue(const char *value, const sJSON_ParseOptions *options, const char **end) {
+   begin_parse(value,options);
+   sJSON *c=parse_new_item();
+   if (!c)
+      return 0;       /* memory fail */
+   if (!(value=parse_value(c,skip(value)))) {
+      parse_failed(c);
+      return 0;
+   }
+   if (end)
+      *end=value;
+   return c;
+}
+
+/* Incremental reparse: the edit is [offset,offset+removed) in the old text, replaced by inserted
+   chars in the new one. */
+typedef struct sJSON_Edit {
+   sJSON_SpanTable *spans, *fresh;     /* spans of the tree / of the reparsed part */
+   const char *text;
+   size_t offset, removed;
+   ptrdiff_t delta;
+   sJSON_ParseOptions options;
+} sJSON_Edit;
+
+static void erase_spans(sJSON_SpanTable *table, sJSON *item) {
+   for (;item;item=item->next) {
+      if (item->type&sJSON_HasSpan) {
+         span_erase(table,item);
+         span_erase(table,SPAN_KEY(item));
+      }
+      erase_spans(table,item->child);
+   }
+}
+
+/* Replace the contents of item by the ones of the freshly parsed c, keeping item and its key. */
+static void splice_parsed(sJSON *item, sJSON *c) {
+   drop_shape(item);
+   sJSONdelete(item->child);
+   item->child=c->child;
+   for (sJSON *child=item->child;child;child=child->next)
+      set_parent(child,item);
+   item->valueString=c->valueString;      /* the slots of a shape */
+   item->nameBloom=c->nameBloom;
+   item->valueInt=c->valueInt;
+   item->type=(c->type&~sJSON_HasSpan)|(item->type&(sJSON_HasSpan|sJSON_IsArena|sJSON_OwnsName));
+   c->child=0;
+   c->valueString=0;
+   c->type&=~sJSON_HasShape;
+   sJSONdelete(c);
+   mark_dirty(item);
+   notify_change(sJSON_ChangeValue,item,0);
+}
+
+/* Take over the spans of the reparse, shifting the ones behind the edit. The table has room. The
+   table is keyed by item, not ordered by offset, so this visits every entry: O(spans) per edit. */
+static void merge_spans(sJSON_Edit *edit) {
+   sJSON_SpanTable *spans=edit->spans;
+   size_t end=edit->offset+edit->removed, i;
+   for (i=0;i<=spans->mask;i++) {
+      sJSON_SpanEntry *e=spans->entries+i;
+      if (!e->item)
+         continue;
+      if (e->offset>=end)
+         e->offset=(uint32_t)(e->offset+edit->delta);
+      else if (e->offset+e->length>end)     /* encloses the edit */
+         e->length=(uint32_t)(e->length+edit->delta);
+   }
+   for (i=0;i<=edit->fresh->mask;i++) {
+      const sJSON_SpanEntry *e=edit->fresh->entries+i;
+      if (e->item)
+         span_insert(spans,e->item,e->offset,e->length);
+   }
+   span_set_source(spans,edit->text);
+}
+
+/* Reparse the container item (of the old span start..start+length), 0 if its new text doesn't
+   parse as one container any more. */
+static int reparse_container(sJSON_Edit *edit, sJSON *item, size_t start, size_t length) {
+   const char *end;
+   sJSON *c;
+   begin_parse(edit->text,&edit->options);
+   if (!(c=sJSON_New_Item()))
+      return 0;
+   end=parse_value(c,edit->text+start);
+   if (end!=edit->text+start+length+edit->delta || !span_reserve(edit->spans,edit->fresh->count)) {
+      sJSONdelete(c);
+      edit->fresh->count=0;
+      memset(edit->fresh->entries,0,(edit->fresh->mask+1)*sizeof(sJSON_SpanEntry));
+      return 0;
+   }
+   span_erase(edit->fresh,c);
+   erase_spans(edit->spans,item->child);
+   splice_parsed(item,c);
+   merge_spans(edit);      /* which also stretches the span of item */
+   return 1;
+}
+
+/* Reparse the smallest container under item enclosing the edit, or if its new text doesn't parse,
+   the next one out. 0 if none did. */
+static int reparse_within(sJSON_Edit *edit, sJSON *item) {
+   const sJSON_SpanEntry *e;
+   for (sJSON *c=item->child;c;c=c->next) {
+      int type=c->type&sJSON_TypeMask;
+      if ((type!=sJSON_Array && type!=sJSON_Object) || !(c->type&sJSON_HasSpan) || !(e=span_find(edit->spans,c)))
+         continue;
+      if (e->offset<edit->offset && edit->offset+edit->removed<=(size_t)e->offset+e->length-1)
+         return reparse_within(edit,c) || reparse_container(edit,c,e->offset,e->length);
+      if (e->offset>=edit->offset+edit->removed)
+         break;      /* the children behind the edit */
+   }
+   return 0;
+}
+
+int sJSONreparse(sJSON *root, sJSON_SpanTable *spans, const char *text, size_t offset, size_t removed, size_t inserted, const sJSON_ParseOptions *options) {
+   sJSON_Edit edit;
+   sJSON *c;
+   int done;
+   if (!(edit.fresh=sJSONspanTableCreate()))
+      return 0;
+   edit.spans=spans;
+   edit.text=text;
+   edit.offset=offset;
+   edit.removed=removed;
+   edit.delta=(ptrdiff_t)inserted-(ptrdiff_t)removed;
+   if (options)
+      edit.options=*options;
+   else
+      memset(&edit.options,0,sizeof(edit.options));
+   edit.options.flags&=~(sJSON_ParseLazyNumbers|sJSON_ParseLazyStrings);
+   edit.options.spans=edit.fresh;
+   edit.options.arena=0;
+   if (!(done=reparse_within(&edit,root)) && (c=sJSONparseWithOptions(text,&edit.options))) {
+      sJSON_SpanEntry *entries=spans->entries;      /* the whole text, take over the new table */
+      span_erase(edit.fresh,c);
+      spans->entries=edit.fresh->entries;
+      spans->mask=edit.fresh->mask;
+      spans->count=edit.fresh->count;
+      span_set_source(spans,text);
+      edit.fresh->entries=entries;
+      splice_parsed(root,c);
+      done=1;
+   }
+   sJSONspanTableDelete(edit.fresh);
+   return done;
+}
+
+sJSON *sJSONparseWithOptions(const char *value, const sJSON_ParseOptions *options) {
+   begin_parse(value,options);
+	sJSON *c=parse_new_item();
    if (!c)
       return 0;       /* memory fail */
 
    value = skip(value);
    if(*value == '{' || *value=='[') {  //old style json-file?
       if (!parse_value(c,skip(value))) {
-         sJSONdelete(c);
+         parse_failed(c);
          return 0;
       }
    } else {
       if (!parse_object(c,skip(value))) {
-         sJSONdelete(c);
+         parse_failed(c);
          return 0;
       }
+      if (parse_options.arena)
+         c->type|=sJSON_IsArena;
    }
 	return c;
 }
 
 #ifdef WRITE_SUPPORT_ENABLED
+   static char *print_text(sJSON *item,int fmt,const sJSON_SpanTable *spans=0) {
+      printbuffer p;
+      if (!item || !printbuffer_init(&p,256))
+         return 0;
+      p.spans=spans;
+      if (!print_value(item,0,fmt,&p) || !print_char(&p,0)) {
+         sJSON_free(p.buffer);
+         return 0;
+      }
+      return p.buffer;
+   }
+
    /* Render a sJSON item/entity/structure to text. */
    char *sJSONprint(sJSON *item)				{
-      return print_value(item,0,1);
+      return print_text(item,1);
    }
    char *sJSONprintUnformatted(sJSON *item)	{
-      return print_value(item,0,0);
+      return print_text(item,0);
+   }
+   char *sJSONprintWithSpans(sJSON *item,int fmt,const sJSON_SpanTable *spans) {
+      return print_text(item,fmt,spans);
+   }
+
+   /* Render to segments: the segment array and the generated text share one allocation. */
+   sJSON_Segment *sJSONprintSegments(sJSON *item,int fmt,int *count) {
+      printbuffer p;
+      sJSON_Segment *out=0;
+      int i;
+      if (!item || !printbuffer_init(&p,256))
+         return 0;
+      p.segments=(printsegment*)sJSON_malloc(64*sizeof(printsegment));
+      p.maxSegments=64;
+      if (p.segments && print_value(item,0,fmt,&p) && add_segment(&p,0,p.segmentStart,p.offset-p.segmentStart))
+         out=(sJSON_Segment*)sJSON_malloc(p.numSegments*sizeof(sJSON_Segment)+p.offset);
+      if (out) {
+         char *text=(char*)(out+p.numSegments);
+         memcpy(text,p.buffer,p.offset);
+         for (i=0;i<p.numSegments;i++) {
+            out[i].data=p.segments[i].ref?p.segments[i].ref:text+p.segments[i].start;
+            out[i].length=p.segments[i].length;
+         }
+         *count=p.numSegments;
+      }
+      sJSON_free(p.segments);
+      sJSON_free(p.buffer);
+      return out;
+   }
+
+#ifdef THREAD_SUPPORT_ENABLED
+   /* Parallel printing: the tree is cut at the first depth which holds enough containers to keep
+      all threads busy. The part above the cut is printed serially with a placeholder segment for
+      each container at the cut, the workers print those containers into buffers of their own and
+      the pieces are stitched together in order. */
+   #define SJSON_PARALLEL_TASKS_PER_THREAD 8
+   #define SJSON_PARALLEL_MAX_DEPTH 16
+
+   /* Number of non-empty containers depth levels below item. */
+   static int count_containers(sJSON *item, int depth) {
+      int count=0;
+      for (sJSON *c=item->child;c;c=c->next)
+         if (c->child)
+            count+=(depth==1)?1:count_containers(c,depth-1);
+      return count;
    }
+
+   typedef struct printtask {
+      sJSON *item;
+      printbuffer out;
+      int ok;
+   } printtask;
+
+   static void print_tasks(printtask *tasks, int numTasks, int depth, int fmt, std::atomic<int> *next) {
+      int i;
+      while ((i=(*next)++)<numTasks) {
+         printtask *t=tasks+i;
+         t->ok=printbuffer_init(&t->out,256) && print_value(t->item,depth,fmt,&t->out);
+      }
+   }
+
+   char *sJSONprintParallel(sJSON *item,int fmt,int numThreads) {
+      int depth, bestDepth=0, bestCount=0, numTasks=0, i, ok;
+      printbuffer p;
+      printtask *tasks;
+      char *out=0, *ptr;
+      size_t total=0;
+
+      if (numThreads<=0)
+         numThreads=(int)std::thread::hardware_concurrency();
+      if (!item || numThreads<=1 || !item->child)
+         return print_text(item,fmt);
+      for (depth=1;depth<=SJSON_PARALLEL_MAX_DEPTH;depth++) {
+         int count=count_containers(item,depth);
+         if (count>bestCount) {
+            bestCount=count;
+            bestDepth=depth;
+         }
+         if (!count || count>=numThreads*SJSON_PARALLEL_TASKS_PER_THREAD)
+            break;
+      }
+      if (bestCount<2)
+         return print_text(item,fmt);
+
+      /* Serial skeleton with placeholders. */
+      if (!printbuffer_init(&p,256))
+         return 0;
+      p.taskDepth=bestDepth;
+      ok=print_value(item,0,fmt,&p) && add_segment(&p,0,p.segmentStart,p.offset-p.segmentStart);
+      tasks=ok?(printtask*)sJSON_malloc(bestCount*sizeof(printtask)):0;
+      if (tasks) {
+         memset(tasks,0,bestCount*sizeof(printtask));
+         for (i=0;i<p.numSegments;i++)
+            if (p.segments[i].task)
+               tasks[numTasks++].item=p.segments[i].task;
+
+         /* Print the subtrees, the calling thread works along. */
+         std::atomic<int> next(0);
+         std::thread *workers=new std::thread[numThreads-1];
+         for (i=0;i<numThreads-1;i++)
+            workers[i]=std::thread(print_tasks,tasks,numTasks,bestDepth,fmt,&next);
+         print_tasks(tasks,numTasks,bestDepth,fmt,&next);
+         for (i=0;i<numThreads-1;i++)
+            workers[i].join();
+         delete[] workers;
+
+         /* Stitch the pieces together. */
+         for (i=0;i<numTasks;i++) {
+            ok=ok && tasks[i].ok;
+            total+=tasks[i].out.offset;
+         }
+         for (i=0;i<p.numSegments;i++)
+            total+=p.segments[i].length;
+         if (ok && (out=(char*)sJSON_malloc(total+1))) {
+            int task=0;
+            ptr=out;
+            for (i=0;i<p.numSegments;i++) {
+               printsegment *seg=p.segments+i;
+               if (seg->task) {
+                  memcpy(ptr,tasks[task].out.buffer,tasks[task].out.offset);
+                  ptr+=tasks[task++].out.offset;
+               } else {
+                  memcpy(ptr,seg->ref?seg->ref:p.buffer+seg->start,seg->length);
+                  ptr+=seg->length;
+               }
+            }
+            *ptr=0;
+         }
+         for (i=0;i<numTasks;i++)
+            sJSON_free(tasks[i].out.buffer);
+         sJSON_free(tasks);
+      }
+      sJSON_free(p.segments);
+      sJSON_free(p.buffer);
+      return out;
+   }
+#endif
 #endif
 
 /* Parser core - when encountering text, process appropriately. */
-static const char *parse_value(sJSON *item,const char *value) {
+static const char *parse_any(sJSON *item,const char *value) {
    if (!value)
       return 0;	/* Fail on null. */
    if (!strncmp(value,"null",4))	{
       item->type=sJSON_NULL;
-      return value+4;
+      return record_span(item,value,value+4)?value+4:0;
    }
    if (!strncmp(value,"false",5)) {
       item->type=sJSON_False;
-      return value+5;
+      return record_span(item,value,value+5)?value+5:0;
    }
    if (!strncmp(value,"true",4))	{
       item->type=sJSON_True;
       item->valueInt=1;
-      return value+4;
+      return record_span(item,value,value+4)?value+4:0;
    }
    if (*value=='-' || (*value>='0' && *value<='9'))
-      return parse_number(item,value);
-   if (*value=='[')
-      return parse_array(item,value);
+   {
+      const char *end;
+      if (parse_options.flags&sJSON_ParseLazyNumbers) {
+         item->type=sJSON_Number|sJSON_IsLazy;
+         item->valueString=(char*)value;
+         end=skip_number(value);
+      } else
+         end=parse_number(item,value);
+      return record_span(item,value,end)?end:0;
+   }
+   if (*value=='[') {
+      const char *end=parse_array(item,value);
+      return record_span(item,value,end)?end:0;
+   }
    if (*value=='{') {
-      return parse_object(item,skip(value+1));
+      const char *end=parse_object(item,skip(value+1));
+      return record_span(item,value,end)?end:0;
+   }
+   if (*value=='\"') {
+      const char *end;
+      if (parse_options.flags&sJSON_ParseLazyStrings)
+         end=parse_string_lazy(item,value);
+      else if (parse_options.strings)
+         end=parse_string_interned(item,value);
+      else
+         end=parse_string(item,value,parse_options.arena);
+      return record_span(item,value,end)?end:0;
    }
-   if (*value=='\"')
-      return parse_string(item,value);
 
    ep=value;
    return 0;	/* failure. */
 }
 
+/* The types set by parsing drop the sJSON_IsArena of items from the parse's arena, put it back. */
+static const char *parse_value(sJSON *item,const char *value) {
+   value=parse_any(item,value);
+   if (parse_options.arena)
+      item->type|=sJSON_IsArena;
+   return value;
+}
+
 #ifdef WRITE_SUPPORT_ENABLED
    /* Render a value to text. */
-   static char *print_value(sJSON *item,int depth,int fmt) {
-      char *out=0;
-      if (!item)
-         return 0;
+   static int print_value(sJSON *item,int depth,int fmt,printbuffer *p) {
+      if (p->taskDepth && depth==p->taskDepth && item->child) {
+         if (!add_segment(p,0,p->segmentStart,p->offset-p->segmentStart) || !add_segment(p,0,0,0,item))
+            return 0;
+         p->segmentStart=p->offset;
+         return 1;
+      }
       switch ((item->type)&255) {
-         case sJSON_NULL:   out=sJSON_strdup("null");	break;
-         case sJSON_False:  out=sJSON_strdup("false");break;
-         case sJSON_True:	 out=sJSON_strdup("true"); break;
-         case sJSON_Number: out=print_number(item);break;
-         case sJSON_String: out=print_string(item);break;
-         case sJSON_Array:  out=print_array(item,depth,fmt);break;
-         case sJSON_Object: out=print_object(item,depth,fmt);break;
+         case sJSON_NULL:   return print_chars(p,"null",4);
+         case sJSON_False:  return print_chars(p,"false",5);
+         case sJSON_True:	 return print_chars(p,"true",4);
+         case sJSON_Number: return print_number(item,p);
+         case sJSON_String: return print_string(item,p);
+#ifdef CHANGE_TRACKING_ENABLED
+         case sJSON_Array:
+         case sJSON_Object: return print_cached(item,depth,fmt,p);
+#else
+         case sJSON_Array:  return print_array(item,depth,fmt,p);
+         case sJSON_Object: return print_object(item,depth,fmt,p);
+#endif
       }
-      return out;
+      return 0;
+   }
+
+#ifdef CHANGE_TRACKING_ENABLED
+   /* Containers printing to at most this many chars keep a copy of their text for as long as they
+      stay clean. A container caching its text drops the caches of its children, so each char is
+      cached once: in the biggest container around it which still fits. Bigger containers are
+      always reprinted from their children. */
+   #define SJSON_PRINT_CACHE_MAX (64*1024)
+
+   struct sJSON_PrintCache {
+      size_t length;
+      int depth, fmt;            /* indentation depends on both */
+      const sJSON_SpanTable *spans;
+      char text[1];
+   };
+
+   static int print_cached(sJSON *item,int depth,int fmt,printbuffer *p) {
+      sJSON_PrintCache *cache=item->printCache;
+      size_t start=p->offset, length;
+      int array=((item->type&255)==sJSON_Array);
+      if (cache && !(item->type&sJSON_IsDirty) && cache->depth==depth && cache->fmt==fmt && cache->spans==p->spans)
+         return print_chars(p,cache->text,cache->length);
+      if (!(array?print_array(item,depth,fmt,p):print_object(item,depth,fmt,p)))
+         return 0;
+      item->type&=~sJSON_IsDirty;
+      if (cache) {
+         sJSON_free(cache);
+         item->printCache=0;
+      }
+      /* Segments and task placeholders leave holes in the buffer, only contiguous text is cached. */
+      length=p->offset-start;
+      if (p->segments || p->taskDepth || length>SJSON_PRINT_CACHE_MAX)
+         return 1;
+      if ((cache=(sJSON_PrintCache*)sJSON_malloc(sizeof(sJSON_PrintCache)+length))) {
+         cache->length=length;
+         cache->depth=depth;
+         cache->fmt=fmt;
+         cache->spans=p->spans;
+         memcpy(cache->text,p->buffer+start,length);
+         item->printCache=cache;
+         for (sJSON *c=item->child;c;c=c->next)
+            if (c->printCache) {
+               sJSON_free(c->printCache);
+               c->printCache=0;
+            }
+      }
+      return 1;
    }
 #endif
+#endif
 
 /* Build an array from input text. */
 static const char *parse_array(sJSON *item,const char *value) {
@@ -436,19 +1942,21 @@ static const char *parse_array(sJSON *item,const char *value) {
    if (*value == ']')     /* empty array. */
       return value+1;
 
-   item->child = child = sJSON_New_Item();
+   item->child = child = parse_new_item();
    if (!item->child) /* memory fail */
       return 0;
+   set_parent(child,item);
    value = skip(parse_value(child,skip(value)));	/* skip any spacing, get the value. */
    if (!value)
       return 0;
 
    while(*value != ']') {
 		sJSON *new_item;
-      if (!(new_item = sJSON_New_Item())) /* memory fail */
+      if (!(new_item = parse_new_item())) /* memory fail */
          return 0;
       child->next = new_item;
       new_item->prev = child;
+      set_parent(new_item,item);
       child = new_item;
       if(*value == ',')
          value=skip(parse_value(child,skip(value+1)));
@@ -466,70 +1974,18 @@ static const char *parse_array(sJSON *item,const char *value) {
 
 #ifdef WRITE_SUPPORT_ENABLED
    /* Render an array to text */
-   static char *print_array(sJSON *item,int depth,int fmt) {
-      char **entries;
-      char *out=0,*ptr,*ret;
-      int len=5;
+   static int print_array(sJSON *item,int depth,int fmt,printbuffer *p) {
       sJSON *child=item->child;
-      int numentries=0,i=0,fail=0;
-
-      /* How many entries in the array? */
-      while (child) {
-         numentries++;
-         child=child->next;
-      }
-      /* Allocate an array to hold the values for each */
-      entries=(char**)sJSON_malloc(numentries*sizeof(char*));
-      if (!entries)
+      if (!print_char(p,'['))
          return 0;
-      memset(entries,0,numentries*sizeof(char*));
-      /* Retrieve all the results: */
-      child=item->child;
-      while (child && !fail) {
-         ret=print_value(child,depth+1,fmt);
-         entries[i++]=ret;
-         if (ret)
-            len+=strlen(ret)+2+(fmt?1:0);
-         else
-            fail=1;
+      while (child) {
+         if (!print_value(child,depth+1,fmt,p))
+            return 0;
          child=child->next;
+         if (child && !(fmt?print_chars(p,", ",2):print_char(p,',')))
+            return 0;
       }
-
-      /* If we didn't fail, try to malloc the output string */
-      if (!fail)
-         out=(char*)sJSON_malloc(len);
-      /* If that fails, we fail. */
-      if (!out)
-         fail=1;
-
-      /* Handle failure. */
-      if (fail) {
-         for (i=0;i<numentries;i++)
-            if (entries[i])
-               sJSON_free(entries[i]);
-         sJSON_free(entries);
-         return 0;
-      }
-
-      /* Compose the output array. */
-      *out='[';
-      ptr=out+1;
-      *ptr=0;
-      for (i=0;i<numentries;i++) {
-         strcpy(ptr,entries[i]);
-         ptr+=strlen(entries[i]);
-         if (i!=numentries-1) {
-            *ptr++=',';
-            if(fmt)
-               *ptr++=' ';
-            *ptr=0;
-         }
-         sJSON_free(entries[i]);
-      }
-      sJSON_free(entries);
-      *ptr++=']';
-      *ptr++=0;
-      return out;
+      return print_char(p,']');
    }
 #endif
 
@@ -543,16 +1999,23 @@ static const char *parse_object(sJSON *item,const char *value) {
 //	value=skip(value+1);
 
 	item->type=sJSON_Object;
+   if (parse_options.flags&sJSON_ParseAdaptiveLookup)
+      item->type|=sJSON_IsAdaptive;
+   if (parse_options.flags&sJSON_ParseBloomLookup)
+      item->type|=sJSON_HasBloom;
    if (*value=='}')     /* empty array. */
       return value+1;
 	
-	item->child=child=sJSON_New_Item();
+	item->child=child=parse_new_item();
    if (!item->child)
       return 0;
-   value=skip(parse_string_or_identifier(child,skip(value)));
+   set_parent(child,item);
+   value=skip(parse_key(child,skip(value)));
    if (!value)
       return 0;
    child->nameHash = eastl::murmurString(child->valueString);
+   if (item->type&sJSON_HasBloom)
+      item->nameBloom |= sJSON_BLOOM_BITS(child->nameHash);
 #ifdef WRITE_SUPPORT_ENABLED
    child->nameString = child->valueString;
 #endif
@@ -567,18 +2030,21 @@ static const char *parse_object(sJSON *item,const char *value) {
 	
    while((*value!='}')&&(*value != 0)) {
 		sJSON *new_item;
-      if (!(new_item=sJSON_New_Item()))
+      if (!(new_item=parse_new_item()))
          return 0; /* memory fail */
       child->next=new_item;
       new_item->prev=child;
+      set_parent(new_item,item);
       child=new_item;
       if(*value == ',')
-         value=skip(parse_string_or_identifier(child,skip(value+1)));
+         value=skip(parse_key(child,skip(value+1)));
       else
-         value=skip(parse_string_or_identifier(child,skip(value)));
+         value=skip(parse_key(child,skip(value)));
       if (!value)
          return 0;
       child->nameHash = eastl::murmurString(child->valueString);
+      if (item->type&sJSON_HasBloom)
+         item->nameBloom |= sJSON_BLOOM_BITS(child->nameHash);
 #ifdef WRITE_SUPPORT_ENABLED
       child->nameString=child->valueString;
 #endif
@@ -592,102 +2058,38 @@ static const char *parse_object(sJSON *item,const char *value) {
          return 0;
 	}
 
-   if(*value == 0)   //file end
-      return value;
-   if(*value == '}')
-      return value+1;	/* end of array */
+   if(*value == 0 || *value == '}') {
+      if (parse_options.shapes)
+         sJSONshapeObject(parse_options.shapes,item);
+      return (*value == 0) ? value : value+1;   /* file end or end of object */
+   }
    ep=value;
    return 0;	/* malformed. */
 }
 
 #ifdef WRITE_SUPPORT_ENABLED
    /* Render an object to text. */
-   static char *print_object(sJSON *item,int depth,int fmt) {
-      char **entries=0, **names=0;
-      char *out=0, *ptr, *ret, *str;
-      int len=7, i=0, j;
-      sJSON *child = item->child;
-      int numentries=0, fail=0;
-      /* Count the number of entries. */
-      while (child) {
-         numentries++;
-         child=child->next;
-      }
-      /* Allocate space for the names and the objects */
-      entries=(char**)sJSON_malloc(numentries*sizeof(char*));
-      if (!entries)
-         return 0;
-      names=(char**)sJSON_malloc(numentries*sizeof(char*));
-      if (!names) {
-         sJSON_free(entries);
+   static int print_object(sJSON *item,int depth,int fmt,printbuffer *p) {
+      sJSON *child=item->child;
+      depth++;
+      if (!print_char(p,'{') || (fmt && !print_char(p,'\n')))
          return 0;
-      }
-      memset(entries,0,sizeof(char*)*numentries);
-      memset(names,0,sizeof(char*)*numentries);
-
-      /* Collect all the results into our arrays: */
-      child=item->child;depth++;
-      if (fmt)
-         len+=depth;
       while (child) {
-         names[i] = str = print_string_ptr(child->nameString);
-         entries[i++] = ret = print_value(child,depth,fmt);
-         if (str && ret)
-            len+=strlen(ret)+strlen(str)+2+(fmt?2+depth:0);
-         else
-            fail=1;
+         if (fmt && !print_tabs(p,depth))
+            return 0;
+         if (!print_string_ptr(child->nameString,p) || !print_char(p,':') || (fmt && !print_char(p,'\t')))
+            return 0;
+         if (!print_value(child,depth,fmt,p))
+            return 0;
+         if (child->next && !print_char(p,','))
+            return 0;
+         if (fmt && !print_char(p,'\n'))
+            return 0;
          child=child->next;
       }
-
-      /* Try to allocate the output string */
-      if (!fail)
-         out=(char*)sJSON_malloc(len);
-      if (!out)
-         fail=1;
-
-      /* Handle failure */
-      if (fail) {
-         for (i=0;i<numentries;i++) {
-            if (names[i])
-               sJSON_free(names[i]);
-            if (entries[i])
-               sJSON_free(entries[i]);
-         }
-         sJSON_free(names);
-         sJSON_free(entries);
-         return 0;
-      }
-
-      /* Compose the output: */
-      *out='{';ptr=out+1;if (fmt)*ptr++='\n';*ptr=0;
-      for (i=0;i<numentries;i++) {
-         if (fmt)
-            for (j=0;j<depth;j++)
-               *ptr++='\t';
-         strcpy(ptr,names[i]);
-         ptr+=strlen(names[i]);
-         *ptr++=':';
-         if (fmt)
-            *ptr++='\t';
-         strcpy(ptr,entries[i]);
-         ptr+=strlen(entries[i]);
-         if (i!=numentries-1)
-            *ptr++=',';
-         if (fmt)
-            *ptr++='\n';
-         *ptr=0;
-         sJSON_free(names[i]);
-         sJSON_free(entries[i]);
-      }
-
-      sJSON_free(names);
-      sJSON_free(entries);
-      if (fmt)
-         for (i=0;i<depth-1;i++)
-            *ptr++='\t';
-      *ptr++='}';
-      *ptr++=0;
-      return out;
+      if (fmt && !print_tabs(p,depth-1))
+         return 0;
+      return print_char(p,'}');
    }
 #endif
 
@@ -710,18 +2112,67 @@ sJSON *sJSONgetArrayItem(sJSON *array,int item) {
    return c;
 }
 sJSON *sJSONgetObjectItem(sJSON *object, eastl::FixedMurmurHash stringHash) {
-   sJSON *c=object->child;
-//   while (c && sJSON_strcasecmp(c->nameString,string))
-   while(c && (c->nameHash != stringHash))
-      c=c->next;
-   return c;
+   return sJSONgetObjectItem(object,(uint32_t)stringHash);
 }
 sJSON *sJSONgetObjectItem(sJSON *object, uint32_t stringHash) {
    sJSON *c=object->child;
+   if ((object->type&sJSON_HasBloom) && (object->nameBloom&sJSON_BLOOM_BITS(stringHash))!=sJSON_BLOOM_BITS(stringHash))
+      return 0;
+   if (object->type&sJSON_HasShape) {
+      int slot=shape_slot(object->slots->shape,stringHash);
+      return (slot<0)?0:object->slots->items[slot];
+   }
+//   while (c && sJSON_strcasecmp(c->nameString,string))
    while(c && (c->nameHash != stringHash))
       c=c->next;
+   if (c && c!=object->child && (object->type&sJSON_IsAdaptive)) {   /* move to front */
+      c->prev->next=c->next;
+      if (c->next)
+         c->next->prev=c->prev;
+      c->prev=0;
+      c->next=object->child;
+      object->child->prev=c;
+      object->child=c;
+      mark_dirty(object);
+   }
    return c;
 }
+sJSON *sJSONgetObjectItemFrom(sJSON *object, uint32_t stringHash, sJSON *hint) {
+   sJSON *c;
+   if ((object->type&sJSON_HasBloom) && (object->nameBloom&sJSON_BLOOM_BITS(stringHash))!=sJSON_BLOOM_BITS(stringHash))
+      return 0;
+#ifdef CHANGE_TRACKING_ENABLED
+   if (hint && hint->parent!=object)
+      hint=0;     /* detached or moved since, start over */
+#else
+   hint=0;        /* membership can't be told without parent links */
+#endif
+   if (!hint || (object->type&(sJSON_HasShape|sJSON_IsAdaptive)))
+      return sJSONgetObjectItem(object,stringHash);
+   for (c=hint;c;c=c->next)
+      if (c->nameHash==stringHash)
+         return c;
+   for (c=object->child;c && c!=hint;c=c->next)
+      if (c->nameHash==stringHash)
+         return c;
+   return 0;
+}
+void   sJSONsetAdaptiveLookup(sJSON *object, int enable) {
+   if (enable)
+      object->type|=sJSON_IsAdaptive;
+   else
+      object->type&=~sJSON_IsAdaptive;
+}
+void   sJSONsetBloomLookup(sJSON *object, int enable) {
+   sJSON *c;
+   object->nameBloom=0;
+   object->type&=~sJSON_HasBloom;
+   if (!enable)
+      return;
+   for (c=object->child;c;c=c->next)
+      object->nameBloom|=sJSON_BLOOM_BITS(c->nameHash);
+   object->type|=sJSON_HasBloom;
+}
 
 /* Utility for array list handling. */
 static void suffix_object(sJSON *prev, sJSON *item) {
@@ -738,8 +2189,14 @@ static sJSON *create_reference(sJSON *item) {
    ref->nameString = 0;
 #endif
    ref->nameHash = 0;
-   ref->type |= sJSON_IsReference;
+   if (ref->type&sJSON_HasShape)      /* the slots stay with the original */
+      ref->slots = 0;
+   ref->type = (ref->type&~(sJSON_IsArena|sJSON_OwnsValue|sJSON_OwnsName|sJSON_HasShape|sJSON_HasBloom))|sJSON_IsReference;
    ref->next = ref->prev = 0;
+#ifdef CHANGE_TRACKING_ENABLED
+   ref->parent = 0;
+   ref->printCache = 0;
+#endif
    return ref;
 }
 
@@ -748,6 +2205,9 @@ void   sJSONaddItemToArray(sJSON *array, sJSON *item) {
    sJSON *c=array->child;
    if (!item)
       return;
+   drop_shape(array);
+   if (array->type&sJSON_HasBloom)
+      array->nameBloom|=sJSON_BLOOM_BITS(item->nameHash);
    if (!c) {
       array->child=item;
    } else {
@@ -755,14 +2215,15 @@ void   sJSONaddItemToArray(sJSON *array, sJSON *item) {
          c=c->next;
       suffix_object(c,item);
    }
+   set_parent(item,array);
+   mark_dirty(array);
+   notify_change(sJSON_ChangeAdd,item,array);
 }
 void   sJSONaddItemToObject(sJSON *object, const char *string, sJSON *item)	{
    if (!item)
       return;
 #ifdef WRITE_SUPPORT_ENABLED
-   if (item->nameString)
-      sJSON_free(item->nameString);
-   item->nameString=sJSON_strdup(string);
+   set_name(item,sJSON_strdup(string));
 #endif
    item->nameHash = eastl::murmurString(string);
    sJSONaddItemToArray(object,item);
@@ -773,6 +2234,20 @@ void	sJSONaddItemReferenceToArray(sJSON *array, sJSON *item) {
 void	sJSONaddItemReferenceToObject(sJSON *object,const char *string,sJSON *item) {
    sJSONaddItemToObject(object,string,create_reference(item));
 }
+int    sJSONaddMemberReference(sJSON *object, sJSON *member) {
+   sJSON *ref=create_reference(member);
+   if (!ref)
+      return 0;
+   ref->nameHash=member->nameHash;
+#ifdef WRITE_SUPPORT_ENABLED
+   if (member->nameString && !(ref->nameString=sJSON_strdup(member->nameString))) {
+      sJSONdelete(ref);
+      return 0;
+   }
+#endif
+   sJSONaddItemToArray(object,ref);
+   return 1;
+}
 
 sJSON *sJSONdetachItemFromArray(sJSON *array, int which)			{
    sJSON *c=array->child;
@@ -782,6 +2257,7 @@ sJSON *sJSONdetachItemFromArray(sJSON *array, int which)			{
    }
    if (!c)
       return 0;
+   drop_shape(array);
    if (c->prev)
       c->prev->next=c->next;
    if (c->next)
@@ -789,6 +2265,9 @@ sJSON *sJSONdetachItemFromArray(sJSON *array, int which)			{
    if (c==array->child)
       array->child=c->next;
    c->prev=c->next=0;
+   set_parent(c,0);
+   mark_dirty(array);
+   notify_change(sJSON_ChangeDetach,c,array);
    return c;
 }
 void   sJSONdeleteItemFromArray(sJSON *array,int which) {
@@ -815,12 +2294,21 @@ void   sJSONdeleteItemFromObject(sJSON *object,const char *string) {
 /* Replace array/object items with new ones. */
 void   sJSONreplaceItemInArray(sJSON *array,int which,sJSON *newitem) {
    sJSON *c=array->child;
+   int slot=which;
    while (c && which>0) {
       c=c->next;
       which--;
    }
    if (!c)
       return;
+   if (array->type&sJSON_HasBloom)
+      array->nameBloom|=sJSON_BLOOM_BITS(newitem->nameHash);
+   if (array->type&sJSON_HasShape) {   /* same key, same slot */
+      if (newitem->nameHash==c->nameHash)
+         array->slots->items[slot]=newitem;
+      else
+         drop_shape(array);
+   }
    newitem->next=c->next;
    newitem->prev=c->prev;
    if (newitem->next)
@@ -830,6 +2318,9 @@ void   sJSONreplaceItemInArray(sJSON *array,int which,sJSON *newitem) {
    else
       newitem->prev->next=newitem;
    c->next=c->prev=0;
+   set_parent(newitem,array);
+   mark_dirty(array);
+   notify_change(sJSON_ChangeReplace,newitem,array);
    sJSONdelete(c);
 }
 void   sJSONreplaceItemInObject(sJSON *object,const char *string,sJSON *newitem) {
@@ -843,13 +2334,388 @@ void   sJSONreplaceItemInObject(sJSON *object,const char *string,sJSON *newitem)
    }
    if(c) {
 #ifdef WRITE_SUPPORT_ENABLED
-      newitem->nameString=sJSON_strdup(string);
+      set_name(newitem,sJSON_strdup(string));
 #endif
       newitem->nameHash = stringHash;
       sJSONreplaceItemInArray(object,i,newitem);
    }
 }
 
+/* Change values in place, flagging the item as modified. */
+static void clear_value(sJSON *item) {
+   drop_shape(item);
+   if (!(item->type&sJSON_IsReference)) {
+      if (item->child)
+         sJSONdelete(item->child);
+      if (frees_value(item))
+         sJSON_free(item->valueString);
+   }
+   item->child=0;
+   item->valueString=0;
+   item->type&=~(sJSON_TypeMask|sJSON_IsReference|sJSON_IsLazy|sJSON_HasEscapes|sJSON_IsInterned|sJSON_IsAdaptive|sJSON_HasBloom|sJSON_OwnsValue);
+   item->valueInt=0;
+}
+void   sJSONsetNumber(sJSON *item,double num) {
+   clear_value(item);
+   item->type|=sJSON_Number;
+   item->valueDouble=num;
+   item->valueInt=(int)num;
+   mark_dirty(item);
+   notify_change(sJSON_ChangeValue,item,0);
+}
+void   sJSONsetBool(sJSON *item,int b) {
+   clear_value(item);
+   item->type|=b?sJSON_True:sJSON_False;
+   item->valueInt=b?1:0;
+   mark_dirty(item);
+   notify_change(sJSON_ChangeValue,item,0);
+}
+int    sJSONsetString(sJSON *item,const char *string) {
+   char *copy=sJSON_strdup(string);
+   if (!copy)
+      return 0;
+   clear_value(item);
+   item->type|=sJSON_String;
+   if (item->type&sJSON_IsArena)
+      item->type|=sJSON_OwnsValue;
+   item->valueString=copy;
+   mark_dirty(item);
+   notify_change(sJSON_ChangeValue,item,0);
+   return 1;
+}
+
+/* Batched edits. Commit sorts the edits by container, resolves the targets of each container with
+   one walk over its children (and a hash map of their keys), and applies them once all resolved. */
+#define SJSON_BATCH_ADD 0
+#define SJSON_BATCH_REPLACE 1
+#define SJSON_BATCH_REMOVE 2
+
+typedef struct sJSON_BatchEdit {
+   sJSON *container;
+   sJSON *item;         /* new item */
+   sJSON *target;       /* resolved member */
+   size_t seq;
+   uint32_t hash;
+   int which;           /* -1 for edits by key */
+   int index;           /* resolved position */
+   int kind;
+} sJSON_BatchEdit;
+
+struct sJSON_Batch {
+   sJSON_BatchEdit *edits;
+   size_t count, size;
+   sJSON **children;    /* scratch for commit */
+   uint32_t *map;
+   char *taken;
+   size_t scratchSize;
+};
+
+sJSON_Batch *sJSONbatchCreate() {
+   sJSON_Batch *batch=(sJSON_Batch*)sJSON_malloc(sizeof(sJSON_Batch));
+   if (batch)
+      memset(batch,0,sizeof(sJSON_Batch));
+   return batch;
+}
+
+void sJSONbatchDelete(sJSON_Batch *batch) {
+   size_t i;
+   if (!batch)
+      return;
+   for (i=0;i<batch->count;i++)
+      sJSONdelete(batch->edits[i].item);
+   sJSON_free(batch->edits);
+   sJSON_free(batch->children);
+   sJSON_free(batch->map);
+   sJSON_free(batch->taken);
+   sJSON_free(batch);
+}
+
+static int batch_queue(sJSON_Batch *batch, int kind, sJSON *container, uint32_t hash, int which, sJSON *item) {
+   sJSON_BatchEdit *e;
+   if (batch->count==batch->size) {
+      size_t size=batch->size?batch->size*2:64;
+      sJSON_BatchEdit *edits=(sJSON_BatchEdit*)sJSON_malloc(size*sizeof(sJSON_BatchEdit));
+      if (!edits)
+         return 0;
+      if (batch->count)
+         memcpy(edits,batch->edits,batch->count*sizeof(sJSON_BatchEdit));
+      sJSON_free(batch->edits);
+      batch->edits=edits;
+      batch->size=size;
+   }
+   e=batch->edits+batch->count;
+   e->container=container;
+   e->item=item;
+   e->target=0;
+   e->seq=batch->count++;
+   e->hash=hash;
+   e->which=which;
+   e->kind=kind;
+   return 1;
+}
+
+int sJSONbatchAdd(sJSON_Batch *batch, sJSON *object, const char *string, sJSON *item) {
+#ifdef WRITE_SUPPORT_ENABLED
+   char *name=sJSON_strdup(string);
+   if (!name)
+      return 0;
+   set_name(item,name);
+#endif
+   item->nameHash=eastl::murmurString(string);
+   return batch_queue(batch,SJSON_BATCH_ADD,object,item->nameHash,-1,item);
+}
+int sJSONbatchReplace(sJSON_Batch *batch, sJSON *object, uint32_t stringHash, sJSON *newitem) {
+   return batch_queue(batch,SJSON_BATCH_REPLACE,object,stringHash,-1,newitem);
+}
+int sJSONbatchRemove(sJSON_Batch *batch, sJSON *object, uint32_t stringHash) {
+   return batch_queue(batch,SJSON_BATCH_REMOVE,object,stringHash,-1,0);
+}
+int sJSONbatchReplaceAt(sJSON_Batch *batch, sJSON *array, int which, sJSON *newitem) {
+   return which>=0 && batch_queue(batch,SJSON_BATCH_REPLACE,array,0,which,newitem);
+}
+int sJSONbatchRemoveAt(sJSON_Batch *batch, sJSON *array, int which) {
+   return which>=0 && batch_queue(batch,SJSON_BATCH_REMOVE,array,0,which,0);
+}
+
+static int batch_order(const void *a, const void *b) {
+   const sJSON_BatchEdit *x=(const sJSON_BatchEdit*)a, *y=(const sJSON_BatchEdit*)b;
+   if (x->container!=y->container)
+      return (x->container<y->container)?-1:1;
+   return (x->seq<y->seq)?-1:(x->seq>y->seq);
+}
+
+/* Resolve the targets of the edits [first,last) of one container, 0 if one is missing or taken. */
+static int batch_resolve(sJSON_Batch *batch, sJSON_BatchEdit *first, sJSON_BatchEdit *last) {
+   sJSON *container=first->container, *c;
+   sJSON_BatchEdit *e;
+   size_t n=0, i, mask=0;
+   int byKey=0;
+   for (c=container->child;c;c=c->next)
+      n++;
+   for (e=first;e<last;e++)
+      byKey|=(e->kind!=SJSON_BATCH_ADD && e->which<0);
+   if (byKey)
+      for (mask=8;mask<n*2;mask*=2)
+         ;
+   if (batch->scratchSize<n+1 || batch->scratchSize<mask) {
+      size_t size=(n+1>mask)?n+1:mask;
+      sJSON_free(batch->children);
+      sJSON_free(batch->map);
+      sJSON_free(batch->taken);
+      batch->children=(sJSON**)sJSON_malloc(size*sizeof(sJSON*));
+      batch->map=(uint32_t*)sJSON_malloc(size*sizeof(uint32_t));
+      batch->taken=(char*)sJSON_malloc(size);
+      batch->scratchSize=(batch->children && batch->map && batch->taken)?size:0;
+      if (!batch->scratchSize)
+         return 0;
+   }
+   for (c=container->child,i=0;c;c=c->next)
+      batch->children[i++]=c;
+   memset(batch->taken,0,n);
+   if (byKey) {
+      mask--;
+      memset(batch->map,0xff,(mask+1)*sizeof(uint32_t));
+      for (i=0;i<n;i++) {
+         size_t j=batch->children[i]->nameHash&mask;
+         while (batch->map[j]!=0xffffffffu && batch->children[batch->map[j]]->nameHash!=batch->children[i]->nameHash)
+            j=(j+1)&mask;
+         if (batch->map[j]==0xffffffffu)     /* the first of duplicate keys, as in a lookup */
+            batch->map[j]=(uint32_t)i;
+      }
+   }
+   for (e=first;e<last;e++) {
+      if (e->kind==SJSON_BATCH_ADD)
+         continue;
+      if (e->which>=0) {
+         i=e->which;
+      } else {
+         size_t j=e->hash&mask;
+         while (batch->map[j]!=0xffffffffu && batch->children[batch->map[j]]->nameHash!=e->hash)
+            j=(j+1)&mask;
+         i=batch->map[j];
+      }
+      if (i>=n || batch->taken[i])
+         return 0;
+      e->target=batch->children[i];
+      e->index=(int)i;
+      batch->taken[i]=1;
+   }
+   return 1;
+}
+
+static void batch_apply(sJSON_BatchEdit *first, sJSON_BatchEdit *last) {
+   sJSON *container=first->container, *tail=container->child;
+   sJSON_BatchEdit *e;
+   for (e=first;e<last;e++)
+      if (e->kind!=SJSON_BATCH_REPLACE || (e->item->nameHash && e->item->nameHash!=e->target->nameHash))
+         drop_shape(container);
+   while (tail && tail->next)
+      tail=tail->next;
+   for (e=first;e<last;e++) {
+      sJSON *c=e->target, *n=e->item;
+      if (e->kind==SJSON_BATCH_ADD) {
+         if (tail)
+            suffix_object(tail,n);
+         else
+            container->child=n;
+         tail=n;
+      } else if (e->kind==SJSON_BATCH_REPLACE) {
+         if (!n->nameHash) {
+            n->nameHash=c->nameHash;
+#ifdef WRITE_SUPPORT_ENABLED
+            if (c->nameString && !n->nameString)
+               set_name(n,sJSON_strdup(c->nameString));
+#endif
+         }
+         n->next=c->next;
+         n->prev=c->prev;
+         if (n->next)
+            n->next->prev=n;
+         if (n->prev)
+            n->prev->next=n;
+         else
+            container->child=n;
+         if (tail==c)
+            tail=n;
+         if (container->type&sJSON_HasShape)
+            container->slots->items[e->index]=n;
+      } else {
+         if (c->prev)
+            c->prev->next=c->next;
+         else
+            container->child=c->next;
+         if (c->next)
+            c->next->prev=c->prev;
+         if (tail==c)
+            tail=c->prev;
+      }
+      if (n) {
+         set_parent(n,container);
+         if (container->type&sJSON_HasBloom)
+            container->nameBloom|=sJSON_BLOOM_BITS(n->nameHash);
+      }
+      if (c) {
+         c->next=c->prev=0;
+         set_parent(c,0);
+      }
+      notify_change((e->kind==SJSON_BATCH_ADD)?sJSON_ChangeAdd:(e->kind==SJSON_BATCH_REPLACE)?sJSON_ChangeReplace:sJSON_ChangeDetach,n?n:c,container);
+      e->item=0;     /* c is deleted once all containers are done, it may hold one of them */
+   }
+   mark_dirty(container);
+}
+
+int sJSONbatchCommit(sJSON_Batch *batch) {
+   sJSON_BatchEdit *first, *last, *end=batch->edits+batch->count;
+   if (!batch->count)
+      return 1;
+   qsort(batch->edits,batch->count,sizeof(sJSON_BatchEdit),batch_order);
+   for (first=batch->edits;first<end;first=last) {
+      for (last=first;last<end && last->container==first->container;last++)
+         ;
+      if (!batch_resolve(batch,first,last))
+         return 0;
+   }
+   for (first=batch->edits;first<end;first=last) {
+      for (last=first;last<end && last->container==first->container;last++)
+         ;
+      batch_apply(first,last);
+   }
+   for (first=batch->edits;first<end;first++)
+      sJSONdelete(first->target);
+   batch->count=0;
+   return 1;
+}
+
+/* Compaction: count the items and string bytes of a tree, then copy it into one block. */
+static int owns_value_string(const sJSON *item) {
+   return item->valueString && !(item->type&(sJSON_IsReference|sJSON_IsLazy|sJSON_IsInterned|sJSON_HasShape));
+}
+
+static int compact_measure(sJSON *item, size_t *items, size_t *text) {
+   *items+=1;
+   if ((item->type&sJSON_IsLazy) && (item->type&sJSON_TypeMask)==sJSON_String && !sJSONgetString(item))
+      return 0;   /* lazy strings move into the block too, they couldn't be resolved there later */
+   if (owns_value_string(item))
+      *text+=strlen(item->valueString)+1;
+#ifdef WRITE_SUPPORT_ENABLED
+   if (item->nameString)
+      *text+=strlen(item->nameString)+1;
+#endif
+   if (!(item->type&sJSON_IsReference))
+      for (sJSON *c=item->child;c;c=c->next)
+         if (!compact_measure(c,items,text))
+            return 0;
+   return 1;
+}
+
+static char *compact_string(const char *str, char **text) {
+   size_t len=strlen(str)+1;
+   char *copy=*text;
+   memcpy(copy,str,len);
+   *text+=len;
+   return copy;
+}
+
+/* Copy item to the next free item of the block, taking over its slots and print cache. */
+static sJSON *compact_copy(sJSON *item, sJSON **next, char **text) {
+   sJSON *copy=(*next)++, *prev=0, *c;
+   int slot=0;
+   memcpy(copy,item,sizeof(sJSON));
+   copy->type=(item->type&~(sJSON_IsCompact|sJSON_OwnsValue|sJSON_OwnsName))|sJSON_IsArena;
+   copy->next=copy->prev=0;
+   if (owns_value_string(item))
+      copy->valueString=compact_string(item->valueString,text);
+#ifdef WRITE_SUPPORT_ENABLED
+   if (item->nameString)
+      copy->nameString=compact_string(item->nameString,text);
+#endif
+   if (item->type&sJSON_HasShape) {
+      item->type&=~sJSON_HasShape;
+      item->slots=0;
+   }
+#ifdef CHANGE_TRACKING_ENABLED
+   item->printCache=0;
+#endif
+   if (item->type&sJSON_IsReference)
+      return copy;
+   copy->child=0;
+   for (c=item->child;c;c=c->next) {
+      sJSON *child=compact_copy(c,next,text);
+      if (prev)
+         suffix_object(prev,child);
+      else
+         copy->child=child;
+      set_parent(child,copy);
+      if (copy->type&sJSON_HasShape)
+         copy->slots->items[slot++]=child;
+      prev=child;
+   }
+   return copy;
+}
+
+sJSON *sJSONcompact(sJSON *item) {
+   size_t items=0, text=0;
+   sJSON *block, *next, *root;
+   char *strings;
+   if (!item || item->next || item->prev)
+      return item;
+#ifdef CHANGE_TRACKING_ENABLED
+   if (item->parent)
+      return item;      /* its container would keep pointing at it */
+#endif
+   if (!compact_measure(item,&items,&text) || !(block=(sJSON*)sJSON_malloc(items*sizeof(sJSON)+text)))
+      return item;
+   next=block;
+   strings=(char*)(block+items);
+   root=compact_copy(item,&next,&strings);
+   root->type|=sJSON_IsCompact;
+#ifdef CHANGE_TRACKING_ENABLED
+   observe_moved(item,root);
+#endif
+   sJSONdelete(item);
+   return root;
+}
+
 #ifdef WRITE_SUPPORT_ENABLED
 /* Create basic types: */
 sJSON *sJSONcreateNull()					{sJSON *item=sJSON_New_Item();if(item)item->type=sJSON_NULL;return item;}
@@ -858,12 +2724,248 @@ sJSON *sJSONcreateFalse()					{sJSON *item=sJSON_New_Item();if(item)item->type=s
 sJSON *sJSONcreateBool(int b)				{sJSON *item=sJSON_New_Item();if(item)item->type=b?sJSON_True:sJSON_False;return item;}
 sJSON *sJSONcreateNumber(double num)	{sJSON *item=sJSON_New_Item();if(item){item->type=sJSON_Number;item->valueDouble=num;item->valueInt=(int)num;}return item;}
 sJSON *sJSONcreateString(const char *string)	{sJSON *item=sJSON_New_Item();if(item){item->type=sJSON_String;item->valueString=sJSON_strdup(string);}return item;}
+sJSON *sJSONcreateBlob(const void *data, size_t size) {
+   size_t len=(size+2)/3*4;
+   sJSON *item=sJSON_New_Item();
+   if (!item)
+      return 0;
+   item->type=sJSON_String;
+   if (!(item->valueString=(char*)sJSON_malloc(len+1))) {
+      sJSON_free(item);
+      return 0;
+   }
+   sJSONkernels.base64Encode((const unsigned char*)data,size,item->valueString);
+   item->valueString[len]=0;
+   return item;
+}
 sJSON *sJSONcreateArray()					{sJSON *item=sJSON_New_Item();if(item)item->type=sJSON_Array;return item;}
 sJSON *sJSONcreateObject()					{sJSON *item=sJSON_New_Item();if(item)item->type=sJSON_Object;return item;}
 
 /* Create Arrays: */
-sJSON *sJSONcreateIntArray(int *numbers,int count)				 {int i;sJSON *n=0,*p=0,*a=sJSONcreateArray();for(i=0;a && i<count;i++){n=sJSONcreateNumber(numbers[i]);if(!i)a->child=n;else suffix_object(p,n);p=n;}return a;}
-sJSON *sJSONcreateFloatArray(float *numbers,int count)		 {int i;sJSON *n=0,*p=0,*a=sJSONcreateArray();for(i=0;a && i<count;i++){n=sJSONcreateNumber(numbers[i]);if(!i)a->child=n;else suffix_object(p,n);p=n;}return a;}
-sJSON *sJSONcreateDoubleArray(double *numbers,int count)		 {int i;sJSON *n=0,*p=0,*a=sJSONcreateArray();for(i=0;a && i<count;i++){n=sJSONcreateNumber(numbers[i]);if(!i)a->child=n;else suffix_object(p,n);p=n;}return a;}
-sJSON *sJSONcreateStringArray(const char **strings,int count){int i;sJSON *n=0,*p=0,*a=sJSONcreateArray();for(i=0;a && i<count;i++){n=sJSONcreateString(strings[i]);if(!i)a->child=n;else suffix_object(p,n);p=n;}return a;}
+sJSON *sJSONcreateIntArray(int *numbers,int count)				 {int i;sJSON *n=0,*p=0,*a=sJSONcreateArray();for(i=0;a && i<count;i++){n=sJSONcreateNumber(numbers[i]);if(!i)a->child=n;else suffix_object(p,n);set_parent(n,a);p=n;}return a;}
+sJSON *sJSONcreateFloatArray(float *numbers,int count)		 {int i;sJSON *n=0,*p=0,*a=sJSONcreateArray();for(i=0;a && i<count;i++){n=sJSONcreateNumber(numbers[i]);if(!i)a->child=n;else suffix_object(p,n);set_parent(n,a);p=n;}return a;}
+sJSON *sJSONcreateDoubleArray(double *numbers,int count)		 {int i;sJSON *n=0,*p=0,*a=sJSONcreateArray();for(i=0;a && i<count;i++){n=sJSONcreateNumber(numbers[i]);if(!i)a->child=n;else suffix_object(p,n);set_parent(n,a);p=n;}return a;}
+sJSON *sJSONcreateStringArray(const char **strings,int count){int i;sJSON *n=0,*p=0,*a=sJSONcreateArray();for(i=0;a && i<count;i++){n=sJSONcreateString(strings[i]);if(!i)a->child=n;else suffix_object(p,n);set_parent(n,a);p=n;}return a;}
+#endif
+
+/* Packed trees: header, nodes, string pool. String offsets are relative to the pool, whose first
+   byte is 0 so offset 0 can mean "no name". */
+#define SJSON_PACKED_MAGIC 0x4b504a73    /* "sJPK" */
+#define SJSON_PACKED_VERSION 1
+
+typedef struct sJSON_PackedNode {
+   uint32_t next, child;
+   uint32_t type, nameHash;
+   uint32_t name, length;     /* name offset, string length */
+   union {
+      double number;
+      uint32_t string;        /* string offset */
+   } value;
+} sJSON_PackedNode;
+
+static sJSON_PackedNode *packed_nodes(const sJSON_Packed *packed) {
+   return (sJSON_PackedNode*)(packed+1);
+}
+static char *packed_pool(const sJSON_Packed *packed) {
+   return (char*)(packed_nodes(packed)+packed->nodeCount);
+}
+
+/* Count nodes and pool bytes of the tree, 0 on memory fail. */
+static int packed_measure(sJSON *item, size_t *nodes, size_t *pool) {
+   size_t length;
+   for (;item;item=item->next) {
+      (*nodes)++;
+#ifdef WRITE_SUPPORT_ENABLED
+      if (item->nameString)
+         *pool+=strlen(item->nameString)+1;
+#endif
+      if ((item->type&sJSON_TypeMask)==sJSON_String) {
+         if (!sJSONgetStringView(item,&length))
+            return 0;
+         *pool+=length+1;
+      }
+      if (!packed_measure(item->child,nodes,pool))
+         return 0;
+   }
+   return 1;
+}
+
+/* Fill in the chain starting at node index *node, returns the index of its first node. */
+static uint32_t packed_fill(sJSON_Packed *packed, sJSON *item, uint32_t *node, uint32_t *pool) {
+   sJSON_PackedNode *nodes=packed_nodes(packed), *prev=0;
+   char *text=packed_pool(packed);
+   uint32_t first=*node;
+   size_t length;
+   for (;item;item=item->next) {
+      sJSON_PackedNode *n=nodes+*node;
+      if (prev)
+         prev->next=*node;
+      (*node)++;
+      memset(n,0,sizeof(sJSON_PackedNode));
+      n->type=item->type&sJSON_TypeMask;
+      n->nameHash=item->nameHash;
+#ifdef WRITE_SUPPORT_ENABLED
+      if (item->nameString) {
+         length=strlen(item->nameString);
+         n->name=*pool;
+         memcpy(text+*pool,item->nameString,length+1);
+         *pool+=(uint32_t)length+1;
+      }
+#endif
+      if (n->type==sJSON_String) {
+         const char *str=sJSONgetStringView(item,&length);
+         n->value.string=*pool;
+         n->length=(uint32_t)length;
+         memcpy(text+*pool,str,length);
+         text[*pool+length]=0;
+         *pool+=(uint32_t)length+1;
+      } else if (n->type==sJSON_Number) {
+         n->value.number=sJSONgetNumberDouble(item);
+      }
+      if (item->child)
+         n->child=packed_fill(packed,item->child,node,pool);
+      prev=n;
+   }
+   return first;
+}
+
+sJSON_Packed *sJSONpack(sJSON *item) {
+   size_t nodes=0, pool=1;
+   uint32_t node=0, offset=1;
+   sJSON_Packed *packed;
+   sJSON *next;
+   if (!item)
+      return 0;
+   next=item->next;     /* only the item itself, not its siblings */
+   item->next=0;
+   if (!packed_measure(item,&nodes,&pool) || pool>0xffffffffu
+      || !(packed=(sJSON_Packed*)sJSON_malloc(sizeof(sJSON_Packed)+nodes*sizeof(sJSON_PackedNode)+pool))) {
+      item->next=next;
+      return 0;
+   }
+   packed->magic=SJSON_PACKED_MAGIC;
+   packed->version=SJSON_PACKED_VERSION;
+   packed->nodeCount=(uint32_t)nodes;
+   packed->poolSize=(uint32_t)pool;
+   packed_pool(packed)[0]=0;
+   packed_fill(packed,item,&node,&offset);
+   item->next=next;
+   return packed;
+}
+
+size_t sJSONpackedSize(const sJSON_Packed *packed) {
+   return sizeof(sJSON_Packed)+packed->nodeCount*sizeof(sJSON_PackedNode)+packed->poolSize;
+}
+
+/* Whether the nodes and pool of packed are safe to walk: links only point forward to existing
+   nodes (so there are no cycles), strings lie inside the pool and are 0-terminated. */
+static int packed_valid(const sJSON_Packed *packed) {
+   const sJSON_PackedNode *nodes=packed_nodes(packed);
+   const char *pool=packed_pool(packed);
+   uint32_t count=packed->nodeCount, size=packed->poolSize, i;
+   if (pool[0] || pool[size-1] || nodes[0].next)
+      return 0;
+   for (i=0;i<count;i++) {
+      const sJSON_PackedNode *n=nodes+i;
+      if (n->type>sJSON_Object || (n->next && (n->next<=i || n->next>=count))
+         || (n->child && (n->child<=i || n->child>=count || (n->type!=sJSON_Array && n->type!=sJSON_Object)))
+         || n->name>=size
+         || (n->type==sJSON_String && ((uint64_t)n->value.string+n->length>=size || pool[n->value.string+n->length])))
+         return 0;
+   }
+   return 1;
+}
+
+const sJSON_Packed *sJSONpackedFromBuffer(const void *data, size_t size) {
+   const sJSON_Packed *packed=(const sJSON_Packed*)data;
+   if (size<sizeof(sJSON_Packed) || packed->magic!=SJSON_PACKED_MAGIC || packed->version!=SJSON_PACKED_VERSION
+      || !packed->nodeCount || !packed->poolSize
+      || packed->nodeCount>(size-sizeof(sJSON_Packed))/sizeof(sJSON_PackedNode)
+      || packed->poolSize>size-sizeof(sJSON_Packed)-packed->nodeCount*sizeof(sJSON_PackedNode)
+      || !packed_valid(packed))
+      return 0;
+   return packed;
+}
+
+int sJSONpackedType(const sJSON_Packed *packed, uint32_t node) {
+   return packed_nodes(packed)[node].type;
+}
+uint32_t sJSONpackedChild(const sJSON_Packed *packed, uint32_t node) {
+   return packed_nodes(packed)[node].child;
+}
+uint32_t sJSONpackedNext(const sJSON_Packed *packed, uint32_t node) {
+   return packed_nodes(packed)[node].next;
+}
+uint32_t sJSONpackedNameHash(const sJSON_Packed *packed, uint32_t node) {
+   return packed_nodes(packed)[node].nameHash;
+}
+const char *sJSONpackedName(const sJSON_Packed *packed, uint32_t node) {
+   uint32_t name=packed_nodes(packed)[node].name;
+   return name?packed_pool(packed)+name:0;
+}
+double sJSONpackedNumber(const sJSON_Packed *packed, uint32_t node) {
+   const sJSON_PackedNode *n=packed_nodes(packed)+node;
+   if (n->type==sJSON_Number)
+      return n->value.number;
+   return n->type==sJSON_True;
+}
+const char *sJSONpackedString(const sJSON_Packed *packed, uint32_t node, size_t *length) {
+   const sJSON_PackedNode *n=packed_nodes(packed)+node;
+   if (n->type!=sJSON_String)
+      return 0;
+   if (length)
+      *length=n->length;
+   return packed_pool(packed)+n->value.string;
+}
+uint32_t sJSONpackedObjectItem(const sJSON_Packed *packed, uint32_t node, uint32_t stringHash) {
+   const sJSON_PackedNode *nodes=packed_nodes(packed);
+   uint32_t c=nodes[node].child;
+   while (c && nodes[c].nameHash!=stringHash)
+      c=nodes[c].next;
+   return c;
+}
+
+static sJSON *unpack_node(const sJSON_Packed *packed, uint32_t node) {
+   const sJSON_PackedNode *n=packed_nodes(packed)+node;
+   sJSON *item=sJSON_New_Item(), *child, *prev=0;
+   uint32_t c;
+   if (!item)
+      return 0;
+   item->type=n->type;
+   item->nameHash=n->nameHash;
+#ifdef WRITE_SUPPORT_ENABLED
+   if (n->name && !(item->nameString=sJSON_strdup(packed_pool(packed)+n->name))) {
+      sJSONdelete(item);
+      return 0;
+   }
 #endif
+   if (n->type==sJSON_String) {
+      if (!(item->valueString=(char*)sJSON_malloc(n->length+1))) {
+         sJSONdelete(item);
+         return 0;
+      }
+      memcpy(item->valueString,packed_pool(packed)+n->value.string,n->length+1);
+   } else if (n->type==sJSON_Number) {
+      item->valueDouble=n->value.number;
+      item->valueInt=(n->value.number<=INT_MAX && n->value.number>=INT_MIN)?(int)n->value.number:0;
+   } else if (n->type==sJSON_True) {
+      item->valueInt=1;
+   }
+   for (c=n->child;c;c=packed_nodes(packed)[c].next) {
+      if (!(child=unpack_node(packed,c))) {
+         sJSONdelete(item);
+         return 0;
+      }
+      if (prev)
+         suffix_object(prev,child);
+      else
+         item->child=child;
+      set_parent(child,item);
+      prev=child;
+   }
+   return item;
+}
+
+sJSON *sJSONunpack(const sJSON_Packed *packed) {
+   return unpack_node(packed,0);
+}
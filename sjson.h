@@ -34,10 +34,36 @@
 #define sJSON_Object 6
 	
 #define sJSON_IsReference 256
+#define sJSON_IsArena 512        /* item and its strings live in a sJSON_Arena, sJSONdelete leaves them alone */
+#define sJSON_IsDirty 1024       /* CHANGE_TRACKING_ENABLED only: item was modified through the API
+                                    (containers: since they were last printed) */
+#define sJSON_HasSpan 2048       /* a sJSON_SpanTable holds the source span of the item (the address of a
+                                    deleted item can be reused, the flag tells the new one apart) */
+#define sJSON_IsLazy 4096        /* value not converted yet, valueString points at its text in the source */
+#define sJSON_HasEscapes 8192    /* lazy string whose text contains escapes */
+#define sJSON_IsInterned 16384   /* valueString is owned by a sJSON_StringTable */
+#define sJSON_HasShape 32768     /* object whose children are indexed through a shared shape */
+#define sJSON_IsCompact 65536    /* root of a sJSONcompact block, which sJSONdelete releases with it */
+#define sJSON_IsAdaptive 131072  /* object moving the members found by sJSONgetObjectItem to the front */
+#define sJSON_HasBloom 262144    /* object keeping nameBloom, so most lookups of absent keys fail at once (sJSONsetBloomLookup) */
+#define sJSON_OwnsValue 524288   /* arena item whose valueString was set through the API, sJSONdelete frees it */
+#define sJSON_OwnsName 1048576   /* arena item whose nameString was set through the API, sJSONdelete frees it */
+
+#define sJSON_TypeMask 255       /* strips the flags above from item->type */
 
 #include "eastl/extra/murmurhash.h"
 
 //#define WRITE_SUPPORT_ENABLED
+//#define THREAD_SUPPORT_ENABLED
+//#define CHANGE_TRACKING_ENABLED
+
+//change tracking keeps parent links and cached container texts for printing. Modify trees through
+//the API only, edits reaching a subtree through a reference do not invalidate the referencing side.
+#ifdef CHANGE_TRACKING_ENABLED
+   #ifndef WRITE_SUPPORT_ENABLED
+      #define WRITE_SUPPORT_ENABLED
+   #endif
+#endif
 
 //save names as strings in debugmode
 #ifdef _DEBUG
@@ -54,15 +80,25 @@ typedef struct sJSON {
                                  a chain of the items in the array/object. */
 	int type;					/* The type of the item, as above. */
 
-   char *valueString;		/* The item's string, if type==sJSON_String */
+   union {
+      char *valueString;		/* The item's string, if type==sJSON_String */
+      struct sJSON_Slots *slots;	/* The children by shape slot, if type has sJSON_HasShape */
+   };
    int valueInt;				/* The item's number, if type==sJSON_Number */
-   double valueDouble;		/* The item's number, if type==sJSON_Number */
+   union {
+      double valueDouble;		/* The item's number, if type==sJSON_Number */
+      uint64_t nameBloom;		/* Bloom filter of the member keys, if type has sJSON_HasBloom */
+   };
 
 #ifdef WRITE_SUPPORT_ENABLED
    char *nameString;			/* The item's name string, if this item is the child of, or is
                               in the list of subitems of an object. */
 #endif
    uint32_t nameHash;
+#ifdef CHANGE_TRACKING_ENABLED
+   struct sJSON *parent;				/* The array/object holding this item. */
+   struct sJSON_PrintCache *printCache;	/* Text of a container as last printed, valid while not dirty. */
+#endif
 } sJSON;
 
 typedef struct sJSON_Hooks {
@@ -72,20 +108,144 @@ typedef struct sJSON_Hooks {
 
 /* Supply malloc, realloc and free functions to sJSON */
 extern void sJSONinitHooks(sJSON_Hooks* hooks);
+/* Allocate and release through the hooks, for buffers passed between sJSON and its user. */
+extern void *sJSONmalloc(size_t sz);
+extern void  sJSONfree(void *ptr);
+
+/* Arena for items and strings which are released together. blockSize 0 selects the default (16kb). */
+typedef struct sJSON_Arena sJSON_Arena;
+extern sJSON_Arena *sJSONarenaCreate(size_t blockSize);
+extern void *sJSONarenaAlloc(sJSON_Arena *arena, size_t sz);
+/* Release all allocations of the arena, one block is kept for reuse. */
+extern void  sJSONarenaReset(sJSON_Arena *arena);
+extern void  sJSONarenaDelete(sJSON_Arena *arena);
+/* Zeroed item flagged sJSON_IsArena and a string copy, both owned by the arena. */
+extern sJSON *sJSONarenaNewItem(sJSON_Arena *arena);
+extern char  *sJSONarenaStrdup(sJSON_Arena *arena, const char *str);
+
+/* Render a number the same way the printer does. buffer needs room for 64 chars, returns the length. */
+extern int sJSONformatNumber(double num, char *buffer);
 
 
 /* Supply a block of JSON, and this returns a sJSON object you can interrogate. Call sJSON_Delete when finished. */
 extern sJSON *sJSONparse(const char *value);
 
+/* Source spans of parsed items, kept out of the items so only parses asking for them pay. Offsets are
+   relative to the parsed text (up to 4gb), a table can serve one parse at a time. */
+typedef struct sJSON_SpanTable sJSON_SpanTable;
+extern sJSON_SpanTable *sJSONspanTableCreate();
+extern void sJSONspanTableDelete(sJSON_SpanTable *table);
+/* Returns 0 if no span was recorded for item. */
+extern int  sJSONgetSourceSpan(const sJSON_SpanTable *table, const sJSON *item, size_t *offset, size_t *length);
+/* The span of the key of a member, recorded with sJSON_ParseKeySpans. */
+extern int  sJSONgetKeySpan(const sJSON_SpanTable *table, const sJSON *item, size_t *offset, size_t *length);
+extern const char *sJSONgetSpanSource(const sJSON_SpanTable *table);
+/* 1-based line and column (in bytes) of an offset into the span source, e.g. of a span or of
+   sJSONgetErrorPtr after a failed parse. The line starts are indexed on the first call after each
+   parse. Returns 0 on memory fail or if the table has no source yet. */
+extern int  sJSONgetLineColumn(sJSON_SpanTable *table, size_t offset, size_t *line, size_t *column);
+
+/* Table sharing one copy of each distinct string value between items (of one or many documents), so
+   equal interned strings have equal pointers. It has to outlive the items using it. */
+typedef struct sJSON_StringTable sJSON_StringTable;
+extern sJSON_StringTable *sJSONstringTableCreate();
+extern void sJSONstringTableDelete(sJSON_StringTable *table);
+/* The table's copy of str, for comparing against interned values by pointer. 0 on memory fail. */
+extern const char *sJSONstringTableIntern(sJSON_StringTable *table, const char *str);
+extern size_t sJSONstringTableCount(const sJSON_StringTable *table);
+
+/* Table of object shapes: objects with the same key sequence share one shape mapping key hashes to
+   slots, and index their children by slot, so key lookups don't walk the chain. Structural changes
+   to an object drop its shape. The table has to outlive the objects using it. */
+typedef struct sJSON_ShapeTable sJSON_ShapeTable;
+extern sJSON_ShapeTable *sJSONshapeTableCreate();
+extern void sJSONshapeTableDelete(sJSON_ShapeTable *table);
+extern size_t sJSONshapeTableCount(const sJSON_ShapeTable *table);
+/* Index the children of an object through a shape of the table. Returns 0 when the object gets
+   none (memory fail or fewer than SJSON_SHAPE_MIN_KEYS keys). */
+extern int sJSONshapeObject(sJSON_ShapeTable *table, sJSON *object);
+
+/* sJSON_ParseOptions flags. Lazy values point into the parsed text, which has to outlive the tree. */
+#define sJSON_ParseLazyNumbers 1    /* convert numbers on first sJSONgetNumberInt/Double */
+#define sJSON_ParseLazyStrings 2    /* unescape string values on first sJSONgetString */
+#define sJSON_ParseAdaptiveLookup 4 /* flag all objects sJSON_IsAdaptive */
+#define sJSON_ParseKeySpans 8       /* with a span table, also record the spans of keys */
+#define sJSON_ParseBloomLookup 16   /* flag all objects sJSON_HasBloom */
+
+/* Optional parse behaviour, zero-initialize and set what you need. */
+typedef struct sJSON_ParseOptions {
+   int flags;
+   sJSON_SpanTable *spans;    /* receives the spans of all values */
+   sJSON_StringTable *strings;   /* interns string values, unless they are parsed lazily */
+   sJSON_ShapeTable *shapes;     /* gives parsed objects shapes */
+   sJSON_Arena *arena;        /* items and strings come from the arena (no shapes or lazy strings then) */
+} sJSON_ParseOptions;
+extern sJSON *sJSONparseWithOptions(const char *value, const sJSON_ParseOptions *options);
+/* Parse one JSON value rather than a whole sjson text, *end (if given) receives the text after it. */
+extern sJSON *sJSONparseValue(const char *value, const sJSON_ParseOptions *options, const char **end);
+/* Update root, parsed with a span table, after an edit of its text: removed chars at offset were
+   replaced by inserted ones, text is the whole new text. Only the smallest array or object enclosing
+   the edit is reparsed (or the next one out if its new text doesn't parse on its own) and its items
+   are replaced, all other items stay as they are and their spans are moved to the new text, which
+   has to stay alive like the old one had to. Returns 0 if the new text doesn't parse, leaving the
+   tree as it was. options as for the first parse, except the lazy flags are ignored: parse root
+   without them too, lazy values would point into the old text.
+   Moving the spans takes one pass over the whole span table, so every edit costs O(spans of the
+   tree) on top of the reparse, however small it is. */
+extern int sJSONreparse(sJSON *root, sJSON_SpanTable *spans, const char *text, size_t offset, size_t removed, size_t inserted, const sJSON_ParseOptions *options);
+
 #ifdef WRITE_SUPPORT_ENABLED
    /* Render a sJSON entity to text for transfer/storage. Free the char* when finished. */
    extern char  *sJSONprint(sJSON *item);
    /* Render a sJSON entity to text for transfer/storage without any formatting. Free the char* when finished. */
    extern char  *sJSONprintUnformatted(sJSON *item);
+   /* Render numbers and strings not modified since parsing (see sJSONsetNumber) by copying their text from
+      the parse recorded in spans, keeping their exact formatting. The parsed text must still be alive. */
+   extern char  *sJSONprintWithSpans(sJSON *item, int fmt, const sJSON_SpanTable *spans);
+
+   /* A piece of printed text, laid out like struct iovec. */
+   typedef struct sJSON_Segment {
+      const char *data;
+      size_t length;
+   } sJSON_Segment;
+   /* Render to a list of segments for writev/sendmsg, formatted if fmt is set. Long strings without
+      escapes are referenced in place, so the item must outlive the segments. The concatenated segments
+      equal sJSONprint/sJSONprintUnformatted. Free the returned array when finished. */
+   extern sJSON_Segment *sJSONprintSegments(sJSON *item, int fmt, int *count);
+
+#ifdef THREAD_SUPPORT_ENABLED
+   /* Render with numThreads threads (0 for one per core), the output equals sJSONprint/sJSONprintUnformatted.
+      The malloc/free hooks must be thread safe. Free the char* when finished. */
+   extern char  *sJSONprintParallel(sJSON *item, int fmt, int numThreads);
+#endif
 #endif
 /* Delete a sJSON entity and all subentities. */
 extern void   sJSONdelete(sJSON *c);
 
+/* Read a number, converting a lazily parsed one on first access (not thread safe for that item).
+   Use these instead of valueInt/valueDouble on trees parsed with sJSON_ParseLazyNumbers. */
+extern int    sJSONgetNumberInt(sJSON *item);
+extern double sJSONgetNumberDouble(sJSON *item);
+
+/* Read a string, copying out and unescaping a lazily parsed one on first access (not thread safe for
+   that item). sJSONgetStringView returns lazily parsed strings without escapes in place, so the text is
+   not 0-terminated there. Use these instead of valueString on trees parsed with sJSON_ParseLazyStrings.
+   Both return 0 on memory fail. */
+extern const char *sJSONgetString(sJSON *item);
+extern const char *sJSONgetStringView(sJSON *item, size_t *length);
+
+/* Blobs: binary data in string values as base64 (RFC 4648, padding optional). They are decoded with the
+   vector kernels, lazily parsed ones straight from the source without a copy of the text. */
+/* Size of the decoded data, (size_t)-1 if item isn't a string of base64 length. */
+extern size_t sJSONgetBlobSize(sJSON *item);
+/* Decode item into buffer, returns the size or (size_t)-1 if it isn't base64 or doesn't fit. */
+extern size_t sJSONgetBlob(sJSON *item, void *buffer, size_t size);
+/* Decode item into memory of the arena, 0 on failure. *size receives the size. */
+extern void  *sJSONarenaGetBlob(sJSON_Arena *arena, sJSON *item, size_t *size);
+
+/* The bits of a key hash in the nameBloom of an object. */
+#define sJSON_BLOOM_BITS(hash) ((1ull<<((hash)&63))|(1ull<<(((hash)>>6)&63)))
+
 /* Returns the number of items in an array (or object). */
 extern uint_t sJSONgetArraySize(sJSON *array);
 /* Retrieve item number "item" from array "array". Returns NULL if unsuccessful. */
@@ -93,6 +253,20 @@ extern sJSON *sJSONgetArrayItem(sJSON *array,int item);
 /* Get item "string" from object. Case SENSITIVE! */
 extern sJSON *sJSONgetObjectItem(sJSON *object, eastl::FixedMurmurHash stringHash);
 extern sJSON *sJSONgetObjectItem(sJSON *object, uint32_t stringHash);
+/* Same, but scanning from hint (usually the member found last) and wrapping around, so fields read
+   in order are found right away. With duplicate keys it may find a later one. The hint is used only
+   while its parent link (CHANGE_TRACKING_ENABLED) says it is still a member of object, otherwise the
+   scan starts at the first member. A hint that has been deleted must not be passed. */
+extern sJSON *sJSONgetObjectItemFrom(sJSON *object, uint32_t stringHash, sJSON *hint);
+/* Let sJSONgetObjectItem move found members to the front, so the hot keys of a big object are found
+   first. This changes the member order, also of printed text. Objects with a shape don't move.
+   Lookups on an adaptive object are writes: they relink its members and flag it dirty. Don't look
+   up members of it while it is iterated, and don't let threads read it concurrently. */
+extern void   sJSONsetAdaptiveLookup(sJSON *object, int enable);
+/* Let the object keep a bloom filter of its member keys, built from the current members, so that
+   lookups of most absent keys fail without a scan. The add and replace functions keep it up to
+   date; after linking members by hand, enable it again. */
+extern void   sJSONsetBloomLookup(sJSON *object, int enable);
 
 
 /* For analysing failed parses. This returns a pointer to the parse error. You'll probably need to look a
@@ -107,6 +281,7 @@ extern const char *sJSONgetErrorPtr();
    extern sJSON *sJSONcreateBool(int b);
    extern sJSON *sJSONcreateNumber(double num);
    extern sJSON *sJSONcreateString(const char *string);
+   extern sJSON *sJSONcreateBlob(const void *data, size_t size);    /* a string of the data in base64 */
    extern sJSON *sJSONcreateArray();
    extern sJSON *sJSONcreateObject();
 
@@ -124,6 +299,8 @@ extern void	sJSONaddItemToObject(sJSON *object,const char *string,sJSON *item);
    sJSON to a new sJSON, but don't want to corrupt your existing sJSON. */
 extern void sJSONaddItemReferenceToArray(sJSON *array, sJSON *item);
 extern void	sJSONaddItemReferenceToObject(sJSON *object,const char *string,sJSON *item);
+/* Append a reference to member (of another object) under the key of member. 0 on memory fail. */
+extern int  sJSONaddMemberReference(sJSON *object, sJSON *member);
 
 /* Remove/Detatch items from Arrays/Objects. */
 extern sJSON *sJSONdetachItemFromArray(sJSON *array,int which);
@@ -135,6 +312,99 @@ extern void   sJSONdeleteItemFromObject(sJSON *object,const char *string);
 extern void sJSONreplaceItemInArray(sJSON *array,int which,sJSON *newitem);
 extern void sJSONreplaceItemInObject(sJSON *object,const char *string,sJSON *newitem);
 
+/* Update values in place. Use these instead of writing the fields, so sJSONprintWithSpans stops
+   copying the parsed text of the item (and with CHANGE_TRACKING_ENABLED it gets flagged
+   sJSON_IsDirty and the cached texts of its containers are dropped).
+   sJSONsetString returns 0 on memory fail. */
+extern void sJSONsetNumber(sJSON *item,double num);
+extern void sJSONsetBool(sJSON *item,int b);
+extern int  sJSONsetString(sJSON *item,const char *string);
+
+/* Batched edits: queue many edits and apply them in one pass per container. Edits refer to the
+   members as they are before the batch (keys by hash, positions by index), each member can be
+   edited once, additions go to the end. sJSONbatchCommit checks all edits first and applies them
+   only if every target exists, returning 1; otherwise it returns 0 and nothing changes. Queued new
+   items belong to the batch until they are committed. The queue calls return 0 on memory fail.
+   Edits inside a member that the batch removes or replaces are applied to it before it is deleted.
+   Unlike sJSONreplaceItemInObject, a replacing item that has a nameHash already keeps its own key. */
+typedef struct sJSON_Batch sJSON_Batch;
+extern sJSON_Batch *sJSONbatchCreate();
+/* Delete the batch and the items of edits not committed. */
+extern void sJSONbatchDelete(sJSON_Batch *batch);
+extern int  sJSONbatchAdd(sJSON_Batch *batch, sJSON *object, const char *string, sJSON *item);
+extern int  sJSONbatchReplace(sJSON_Batch *batch, sJSON *object, uint32_t stringHash, sJSON *newitem);
+extern int  sJSONbatchRemove(sJSON_Batch *batch, sJSON *object, uint32_t stringHash);
+extern int  sJSONbatchReplaceAt(sJSON_Batch *batch, sJSON *array, int which, sJSON *newitem);
+extern int  sJSONbatchRemoveAt(sJSON_Batch *batch, sJSON *array, int which);
+extern int  sJSONbatchCommit(sJSON_Batch *batch);
+
+/* Kinds of change records. */
+#define sJSON_ChangeAdd 1
+#define sJSON_ChangeDetach 2
+#define sJSON_ChangeReplace 3
+#define sJSON_ChangeValue 4
+
+#ifdef CHANGE_TRACKING_ENABLED
+   /* Change records of an observed tree. node is the added, detached or replacing item, or the one
+      whose value was set; it identifies the change but may be deleted by the time the record is read.
+      pathHash combines the key hashes from the root down to node (array positions don't count). */
+   typedef struct sJSON_Change {
+      sJSON *node, *parent;
+      int kind;
+      uint32_t nameHash, pathHash;
+   } sJSON_Change;
+
+   /* Lock-free ring of change records for one producer (the thread editing the tree) and one
+      consumer. When it is full, records are dropped and counted, the consumer has to rescan then. */
+   typedef struct sJSON_ChangeRing sJSON_ChangeRing;
+   extern sJSON_ChangeRing *sJSONchangeRingCreate(size_t capacity);
+   extern void   sJSONchangeRingDelete(sJSON_ChangeRing *ring);
+   /* Take the oldest record, returns 0 if there is none. */
+   extern int    sJSONpollChange(sJSON_ChangeRing *ring, sJSON_Change *change);
+   extern size_t sJSONchangesDropped(const sJSON_ChangeRing *ring);
+   /* Send the changes of the tree under root to ring, or stop with ring 0. Up to 16 trees can be
+      observed at once, 0 when that is exceeded. Deleting root stops observing it. The table of
+      observed trees is shared, with THREAD_SUPPORT_ENABLED it is locked so trees of different
+      threads can be observed and edited at once. */
+   extern int    sJSONobserve(sJSON *root, sJSON_ChangeRing *ring);
+#endif
+
+/* Move a tree into one block in depth-first order, strings alongside, to regain the locality of a
+   fresh parse after editing. Returns the new root (the old items are gone) or, on memory fail or for
+   an item that isn't a root, item itself. Only pass roots: without CHANGE_TRACKING_ENABLED the only
+   child of a container can't be told from a root, and its container would be left pointing at
+   freed memory. A tree observed with sJSONobserve stays observed under the new root. Items of the
+   block are flagged sJSON_IsArena: ones detached from the tree stay valid until the root is deleted. */
+extern sJSON *sJSONcompact(sJSON *item);
+
+/* Packed form of a tree: one block of 32 byte nodes linked by 32-bit indices, followed by the
+   string pool. It holds no pointers, so it can be moved, mapped or written to disk as is (in the
+   byte order of the machine). Node 0 is the root; 0 as a child or next index means none. */
+typedef struct sJSON_Packed {
+   uint32_t magic, version;
+   uint32_t nodeCount, poolSize;
+} sJSON_Packed;
+
+/* Pack a tree into one sJSON_malloc block, released with the free hook. 0 on memory fail. */
+extern sJSON_Packed *sJSONpack(sJSON *item);
+extern size_t sJSONpackedSize(const sJSON_Packed *packed);
+/* The packed tree held in data, or 0 if data doesn't hold a well-formed one in size bytes: every
+   link points forward to a node inside, every string lies 0-terminated inside the pool. */
+extern const sJSON_Packed *sJSONpackedFromBuffer(const void *data, size_t size);
+/* Rebuild a regular tree from the packed one. */
+extern sJSON *sJSONunpack(const sJSON_Packed *packed);
+
+extern int      sJSONpackedType(const sJSON_Packed *packed, uint32_t node);
+extern uint32_t sJSONpackedChild(const sJSON_Packed *packed, uint32_t node);
+extern uint32_t sJSONpackedNext(const sJSON_Packed *packed, uint32_t node);
+extern uint32_t sJSONpackedNameHash(const sJSON_Packed *packed, uint32_t node);
+/* The key of the node when the tree was packed with names (WRITE_SUPPORT_ENABLED), otherwise 0. */
+extern const char *sJSONpackedName(const sJSON_Packed *packed, uint32_t node);
+extern double   sJSONpackedNumber(const sJSON_Packed *packed, uint32_t node);
+extern const char *sJSONpackedString(const sJSON_Packed *packed, uint32_t node, size_t *length);
+/* Child of an object with the key hash, 0 if there is none. */
+extern uint32_t sJSONpackedObjectItem(const sJSON_Packed *packed, uint32_t node, uint32_t stringHash);
+
 #ifdef WRITE_SUPPORT_ENABLED
 #define sJSONaddNullToObject(object,name)       sJSONaddItemToObject(object, name, sJSONcreateNull())
 #define sJSONaddTrueToObject(object,name)       sJSONaddItemToObject(object, name, sJSONcreateTrue())
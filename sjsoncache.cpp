@@ -0,0 +1,262 @@
+/*
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* sJSON parse cache. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "murmurhash.h"
+#include "sjsoncache.h"
+
+#define SJSON_CACHE_MAGIC 0x4b434a73     /* "sJCK" */
+#define SJSON_CACHE_VERSION 1            /* bump when the parser changes what it makes of a text */
+#define SJSON_CACHE_CHUNK (1u<<30)       /* bytes per murmur call, lengths are 32-bit */
+
+/* A cache file: this header, then the packed tree. */
+typedef struct sJSON_CacheHeader {
+   uint32_t magic, version;
+   uint64_t key[2];
+   uint64_t size;       /* of the packed tree */
+} sJSON_CacheHeader;
+
+struct sJSON_Cache {
+   char *directory;
+   int flags;
+};
+
+struct sJSON_Cached {
+   const sJSON_Packed *packed;
+   void *base;          /* the mapping on a hit, the packed block on a miss */
+   size_t size;
+   int hit;
+};
+
+sJSON_Cache *sJSONcacheCreate(const char *directory, const sJSON_ParseOptions *options) {
+   size_t len=strlen(directory)+1;
+   sJSON_Cache *cache=(sJSON_Cache*)sJSONmalloc(sizeof(sJSON_Cache));
+   if (!cache)
+      return 0;
+   if (!(cache->directory=(char*)sJSONmalloc(len))) {
+      sJSONfree(cache);
+      return 0;
+   }
+   memcpy(cache->directory,directory,len);
+   cache->flags=options?options->flags:0;
+   return cache;
+}
+
+void sJSONcacheDelete(sJSON_Cache *cache) {
+   if (!cache)
+      return;
+   sJSONfree(cache->directory);
+   sJSONfree(cache);
+}
+
+/* Key of a text: the hash of its contents, hashed again with everything else that shapes the tree. */
+static void cache_key(const sJSON_Cache *cache, const char *text, size_t size, uint64_t key[2]) {
+   uint64_t seed[4];
+   eastl::murmurHash_x64_128((const uint8_t*)text,(uint32_t)(size<SJSON_CACHE_CHUNK?size:SJSON_CACHE_CHUNK),key);
+   for (size_t done=SJSON_CACHE_CHUNK;done<size;done+=SJSON_CACHE_CHUNK) {
+      size_t len=size-done;
+      seed[0]=key[0];
+      seed[1]=key[1];
+      eastl::murmurHash_x64_128((const uint8_t*)text+done,(uint32_t)(len<SJSON_CACHE_CHUNK?len:SJSON_CACHE_CHUNK),seed+2);
+      eastl::murmurHash_x64_128((const uint8_t*)seed,sizeof(seed),key);
+   }
+   seed[0]=key[0];
+   seed[1]=key[1];
+   seed[2]=(uint64_t)SJSON_CACHE_VERSION<<32 | (uint32_t)cache->flags;
+#ifdef WRITE_SUPPORT_ENABLED
+   seed[3]=1;     /* packed with names */
+#else
+   seed[3]=0;
+#endif
+   eastl::murmurHash_x64_128((const uint8_t*)seed,sizeof(seed),key);
+}
+
+static void cache_path(const sJSON_Cache *cache, const uint64_t key[2], char *path, size_t size) {
+   snprintf(path,size,"%s/%016llx%016llx.sjc",cache->directory,(unsigned long long)key[0],(unsigned long long)key[1]);
+}
+
+static sJSON_Cached *cache_map(const char *path, const uint64_t key[2]) {
+   struct stat info;
+   sJSON_Cached *cached;
+   const sJSON_CacheHeader *header;
+   void *base;
+   int fd=open(path,O_RDONLY);
+   if (fd<0)
+      return 0;
+   if (fstat(fd,&info)<0 || (size_t)info.st_size<sizeof(sJSON_CacheHeader)) {
+      close(fd);
+      return 0;
+   }
+   base=mmap(0,(size_t)info.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+   close(fd);
+   if (base==MAP_FAILED)
+      return 0;
+   header=(const sJSON_CacheHeader*)base;
+   if (header->magic!=SJSON_CACHE_MAGIC || header->version!=SJSON_CACHE_VERSION || header->key[0]!=key[0] || header->key[1]!=key[1]
+      || header->size!=(size_t)info.st_size-sizeof(sJSON_CacheHeader) || !(cached=(sJSON_Cached*)sJSONmalloc(sizeof(sJSON_Cached)))) {
+      munmap(base,(size_t)info.st_size);
+      return 0;
+   }
+   /* a stale packed version or a damaged entry fails the full check of the packed tree (links,
+      string offsets, terminators) and is a miss, the entry is written again */
+   if (!(cached->packed=sJSONpackedFromBuffer(header+1,(size_t)header->size))) {
+      munmap(base,(size_t)info.st_size);
+      sJSONfree(cached);
+      return 0;
+   }
+   cached->base=base;
+   cached->size=(size_t)info.st_size;
+   cached->hit=1;
+   return cached;
+}
+
+static int write_all(int fd, const void *data, size_t size) {
+   while (size) {
+      ssize_t done=write(fd,data,size);
+      if (done<0 && errno==EINTR)
+         continue;
+      if (done<=0)
+         return 0;
+      data=(const char*)data+done;
+      size-=(size_t)done;
+   }
+   return 1;
+}
+
+/* Write to a temporary file and rename it, so a concurrent reader never maps half an entry. */
+static void cache_store(const char *path, const uint64_t key[2], const sJSON_Packed *packed) {
+   sJSON_CacheHeader header;
+   size_t len=strlen(path);
+   char *temp=(char*)sJSONmalloc(len+8);
+   int fd, ok;
+   if (!temp)
+      return;
+   memcpy(temp,path,len);
+   memcpy(temp+len,".XXXXXX",8);
+   if ((fd=mkstemp(temp))<0) {
+      sJSONfree(temp);
+      return;
+   }
+   memset(&header,0,sizeof(header));
+   header.magic=SJSON_CACHE_MAGIC;
+   header.version=SJSON_CACHE_VERSION;
+   header.key[0]=key[0];
+   header.key[1]=key[1];
+   header.size=sJSONpackedSize(packed);
+   ok=write_all(fd,&header,sizeof(header)) && write_all(fd,packed,(size_t)header.size);
+   if (close(fd)<0)
+      ok=0;
+   if (!ok || rename(temp,path)<0)
+      unlink(temp);
+   sJSONfree(temp);
+}
+
+sJSON_Cached *sJSONcacheParse(sJSON_Cache *cache, const char *text, size_t size) {
+   sJSON_ParseOptions options;
+   sJSON_Cached *cached;
+   sJSON_Packed *packed;
+   sJSON *root;
+   uint64_t key[2];
+   size_t len=strlen(cache->directory)+40;
+   char *path=(char*)sJSONmalloc(len);
+   if (!path)
+      return 0;
+   cache_key(cache,text,size,key);
+   cache_path(cache,key,path,len);
+   if ((cached=cache_map(path,key))) {
+      sJSONfree(path);
+      return cached;
+   }
+
+   memset(&options,0,sizeof(options));
+   options.flags=cache->flags;
+   root=sJSONparseWithOptions(text,&options);
+   packed=root?sJSONpack(root):0;
+   sJSONdelete(root);
+   if (packed && !(cached=(sJSON_Cached*)sJSONmalloc(sizeof(sJSON_Cached)))) {
+      sJSONfree(packed);
+      packed=0;
+   }
+   if (packed) {
+      cache_store(path,key,packed);
+      cached->packed=packed;
+      cached->base=packed;
+      cached->size=sJSONpackedSize(packed);
+      cached->hit=0;
+   }
+   sJSONfree(path);
+   return cached;
+}
+
+sJSON_Cached *sJSONcacheLoad(sJSON_Cache *cache, const char *path) {
+   struct stat info;
+   sJSON_Cached *cached=0;
+   size_t done=0;
+   char *text;
+   int fd=open(path,O_RDONLY);
+   if (fd<0)
+      return 0;
+   if (fstat(fd,&info)<0 || !(text=(char*)sJSONmalloc((size_t)info.st_size+1))) {
+      close(fd);
+      return 0;
+   }
+   while (done<(size_t)info.st_size) {
+      ssize_t got=read(fd,text+done,(size_t)info.st_size-done);
+      if (got<0 && errno==EINTR)
+         continue;
+      if (got<=0)
+         break;
+      done+=(size_t)got;
+   }
+   close(fd);
+   if (done==(size_t)info.st_size) {
+      text[done]=0;
+      cached=sJSONcacheParse(cache,text,done);
+   }
+   sJSONfree(text);
+   return cached;
+}
+
+const sJSON_Packed *sJSONcachedTree(const sJSON_Cached *cached) {
+   return cached->packed;
+}
+
+int sJSONcachedHit(const sJSON_Cached *cached) {
+   return cached->hit;
+}
+
+void sJSONcachedRelease(sJSON_Cached *cached) {
+   if (!cached)
+      return;
+   if (cached->hit)
+      munmap(cached->base,cached->size);
+   else
+      sJSONfree(cached->base);
+   sJSONfree(cached);
+}
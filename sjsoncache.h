@@ -0,0 +1,49 @@
+/*
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include "sjson.h"
+
+#ifndef sJSONcache__h
+#define sJSONcache__h
+
+/* On-disk parse cache. A text is looked up by a 128-bit murmur hash of its contents and of the parse
+   flags. On a hit the packed tree is mapped from the cache file. On a miss the text is parsed,
+   packed, and written to the cache for the next run. */
+
+typedef struct sJSON_Cache sJSON_Cache;
+typedef struct sJSON_Cached sJSON_Cached;    /* a tree taken from the cache */
+
+/* Cache in directory, which has to exist. Only the flags of options are used. */
+extern sJSON_Cache *sJSONcacheCreate(const char *directory, const sJSON_ParseOptions *options);
+extern void sJSONcacheDelete(sJSON_Cache *cache);
+
+/* The tree of text, which is 0-terminated after size bytes. 0 if it can't be parsed
+   (sJSONgetErrorPtr tells where) or on memory fail. A failed write to the cache isn't an error, the tree is still returned. */
+extern sJSON_Cached *sJSONcacheParse(sJSON_Cache *cache, const char *text, size_t size);
+/* The tree of the file at path, 0 if it can't be read or parsed. */
+extern sJSON_Cached *sJSONcacheLoad(sJSON_Cache *cache, const char *path);
+
+/* Valid until the entry is released, sJSONunpack makes a regular tree of it. */
+extern const sJSON_Packed *sJSONcachedTree(const sJSON_Cached *cached);
+/* 1 if the tree was mapped from the cache, 0 if it was parsed. */
+extern int  sJSONcachedHit(const sJSON_Cached *cached);
+extern void sJSONcachedRelease(sJSON_Cached *cached);
+
+#endif
@@ -0,0 +1,429 @@
+/*
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* sJSON CPU feature dispatch. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "sjsoncpu.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+   #define SJSON_X86
+   #include <immintrin.h>
+   #ifdef _MSC_VER
+      #include <intrin.h>
+      #define SJSON_TARGET(isa)     /* intrinsics need no switches */
+      #define SJSON_NO_ASAN
+   #else
+      #include <cpuid.h>
+      #define SJSON_TARGET(isa) __attribute__((target(isa)))
+      #define SJSON_NO_ASAN __attribute__((no_sanitize_address))
+   #endif
+#endif
+
+static const char *scan_string_scalar(const char *str) {
+   while (*str!='\"' && *str!='\\' && *str)
+      str++;
+   return str;
+}
+
+static const char *scan_plain_scalar(const char *str, const char *end) {
+   while (str<end && (unsigned char)*str>31 && *str!='\"' && *str!='\\')
+      str++;
+   return str;
+}
+
+/* Base64 (RFC 4648) alphabet and its inverse, X for chars outside it. */
+static const char base64Chars[]="ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+#define X 0xff
+static const unsigned char base64Values[256]={
+   X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,
+   X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,
+   X,X,X,X,X,X,X,X,X,X,X,62,X,X,X,63,
+   52,53,54,55,56,57,58,59,60,61,X,X,X,X,X,X,
+   X,0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,
+   15,16,17,18,19,20,21,22,23,24,25,X,X,X,X,X,
+   X,26,27,28,29,30,31,32,33,34,35,36,37,38,39,40,
+   41,42,43,44,45,46,47,48,49,50,51,X,X,X,X,X,
+   X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,
+   X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,
+   X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,
+   X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,
+   X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,
+   X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,
+   X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,
+   X,X,X,X,X,X,X,X,X,X,X,X,X,X,X,X};
+#undef X
+
+static int base64_decode_scalar(const char *src, size_t len, unsigned char *out) {
+   const unsigned char *s=(const unsigned char*)src;
+   uint32_t a, b, c, d;
+   for (;len>=4;len-=4,s+=4,out+=3) {
+      a=base64Values[s[0]]; b=base64Values[s[1]]; c=base64Values[s[2]]; d=base64Values[s[3]];
+      if ((a|b|c|d)&0x80)
+         return 0;
+      a=(a<<18)|(b<<12)|(c<<6)|d;
+      out[0]=(unsigned char)(a>>16);
+      out[1]=(unsigned char)(a>>8);
+      out[2]=(unsigned char)a;
+   }
+   if (len>=2) {     /* 2 or 3 chars left, for 1 or 2 bytes */
+      a=base64Values[s[0]]; b=base64Values[s[1]]; c=(len==3)?base64Values[s[2]]:0;
+      if ((a|b|c)&0x80)
+         return 0;
+      out[0]=(unsigned char)((a<<2)|(b>>4));
+      if (len==3)
+         out[1]=(unsigned char)((b<<4)|(c>>2));
+   }
+   return 1;
+}
+
+static void base64_encode_scalar(const unsigned char *src, size_t size, char *out) {
+   for (;size>=3;size-=3,src+=3,out+=4) {
+      uint32_t v=((uint32_t)src[0]<<16)|((uint32_t)src[1]<<8)|src[2];
+      out[0]=base64Chars[v>>18];
+      out[1]=base64Chars[(v>>12)&63];
+      out[2]=base64Chars[(v>>6)&63];
+      out[3]=base64Chars[v&63];
+   }
+   if (size) {
+      uint32_t v=((uint32_t)src[0]<<16)|((size==2)?(uint32_t)src[1]<<8:0);
+      out[0]=base64Chars[v>>18];
+      out[1]=base64Chars[(v>>12)&63];
+      out[2]=(size==2)?base64Chars[(v>>6)&63]:'=';
+      out[3]='=';
+   }
+}
+
+#ifdef SJSON_X86
+static inline int lowest_bit(uint64_t mask) {
+#ifdef _MSC_VER
+   unsigned long index;
+   _BitScanForward64(&index,mask);
+   return (int)index;
+#else
+   return __builtin_ctzll(mask);
+#endif
+}
+
+/* The scanString kernels start at the aligned vector holding str and drop the bytes before it.
+   Aligned loads can read past the terminating 0 but never into the next page. */
+SJSON_TARGET("sse4.2") SJSON_NO_ASAN
+static const char *scan_string_sse42(const char *str) {
+   const __m128i quote=_mm_set1_epi8('\"'), backslash=_mm_set1_epi8('\\'), zero=_mm_setzero_si128();
+   const char *block=(const char*)((uintptr_t)str&~(uintptr_t)15);
+   uint32_t mask;
+   __m128i v=_mm_load_si128((const __m128i*)block);
+   mask=_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v,quote),_mm_cmpeq_epi8(v,backslash)),_mm_cmpeq_epi8(v,zero)));
+   mask&=~0u<<(str-block);
+   while (!mask) {
+      block+=16;
+      v=_mm_load_si128((const __m128i*)block);
+      mask=_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v,quote),_mm_cmpeq_epi8(v,backslash)),_mm_cmpeq_epi8(v,zero)));
+   }
+   return block+lowest_bit(mask);
+}
+
+/* Control chars, quotes and backslashes as ranges for pcmpestri. */
+SJSON_TARGET("sse4.2")
+static const char *scan_plain_sse42(const char *str, const char *end) {
+   const __m128i ranges=_mm_setr_epi8(0,31,'\"','\"','\\','\\',0,0,0,0,0,0,0,0,0,0);
+   while (end-str>=16) {
+      int index=_mm_cmpestri(ranges,6,_mm_loadu_si128((const __m128i*)str),16,_SIDD_UBYTE_OPS|_SIDD_CMP_RANGES|_SIDD_LEAST_SIGNIFICANT);
+      if (index<16)
+         return str+index;
+      str+=16;
+   }
+   return scan_plain_scalar(str,end);
+}
+
+SJSON_TARGET("avx2") SJSON_NO_ASAN
+static const char *scan_string_avx2(const char *str) {
+   const __m256i quote=_mm256_set1_epi8('\"'), backslash=_mm256_set1_epi8('\\'), zero=_mm256_setzero_si256();
+   const char *block=(const char*)((uintptr_t)str&~(uintptr_t)31);
+   uint32_t mask;
+   __m256i v=_mm256_load_si256((const __m256i*)block);
+   mask=(uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v,quote),_mm256_cmpeq_epi8(v,backslash)),_mm256_cmpeq_epi8(v,zero)));
+   mask&=~0u<<(str-block);
+   while (!mask) {
+      block+=32;
+      v=_mm256_load_si256((const __m256i*)block);
+      mask=(uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v,quote),_mm256_cmpeq_epi8(v,backslash)),_mm256_cmpeq_epi8(v,zero)));
+   }
+   return block+lowest_bit(mask);
+}
+
+SJSON_TARGET("avx2")
+static const char *scan_plain_avx2(const char *str, const char *end) {
+   const __m256i quote=_mm256_set1_epi8('\"'), backslash=_mm256_set1_epi8('\\'), control=_mm256_set1_epi8(31);
+   while (end-str>=32) {
+      __m256i v=_mm256_loadu_si256((const __m256i*)str);
+      uint32_t mask=(uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v,quote),_mm256_cmpeq_epi8(v,backslash)),
+         _mm256_cmpeq_epi8(_mm256_min_epu8(v,control),v)));     /* v<=31 */
+      if (mask)
+         return str+lowest_bit(mask);
+      str+=32;
+   }
+   if (end-str>=16) {   /* the tail stays in VEX code, legacy SSE here would stall on the dirty upper halves */
+      __m128i v=_mm_loadu_si128((const __m128i*)str);
+      uint32_t mask=(uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v,_mm256_castsi256_si128(quote)),
+         _mm_cmpeq_epi8(v,_mm256_castsi256_si128(backslash))),_mm_cmpeq_epi8(_mm_min_epu8(v,_mm256_castsi256_si128(control)),v)));
+      if (mask)
+         return str+lowest_bit(mask);
+      str+=16;
+   }
+   return scan_plain_scalar(str,end);
+}
+
+SJSON_TARGET("avx512f,avx512bw") SJSON_NO_ASAN
+static const char *scan_string_avx512(const char *str) {
+   const __m512i quote=_mm512_set1_epi8('\"'), backslash=_mm512_set1_epi8('\\');
+   const char *block=(const char*)((uintptr_t)str&~(uintptr_t)63);
+   __m512i v=_mm512_load_si512((const void*)block);
+   uint64_t mask=_mm512_cmpeq_epi8_mask(v,quote)|_mm512_cmpeq_epi8_mask(v,backslash)|_mm512_testn_epi8_mask(v,v);
+   mask&=~0ull<<(str-block);
+   while (!mask) {
+      block+=64;
+      v=_mm512_load_si512((const void*)block);
+      mask=_mm512_cmpeq_epi8_mask(v,quote)|_mm512_cmpeq_epi8_mask(v,backslash)|_mm512_testn_epi8_mask(v,v);
+   }
+   return block+lowest_bit(mask);
+}
+
+SJSON_TARGET("avx512f,avx512bw")
+static const char *scan_plain_avx512(const char *str, const char *end) {
+   const __m512i quote=_mm512_set1_epi8('\"'), backslash=_mm512_set1_epi8('\\'), control=_mm512_set1_epi8(32);
+   while (end-str>=64) {
+      __m512i v=_mm512_loadu_si512((const void*)str);
+      uint64_t mask=_mm512_cmpeq_epi8_mask(v,quote)|_mm512_cmpeq_epi8_mask(v,backslash)|_mm512_cmplt_epu8_mask(v,control);
+      if (mask)
+         return str+lowest_bit(mask);
+      str+=64;
+   }
+   if (str<end) {    /* masked load, the bytes past end aren't touched */
+      __m512i v=_mm512_maskz_loadu_epi8(~0ull>>(64-(end-str)),(const void*)str);
+      uint64_t mask=(_mm512_cmpeq_epi8_mask(v,quote)|_mm512_cmpeq_epi8_mask(v,backslash)|_mm512_cmplt_epu8_mask(v,control))&(~0ull>>(64-(end-str)));
+      return mask?str+lowest_bit(mask):end;
+   }
+   return end;
+}
+
+/* Base64 in vectors (after Mula and Lemire): decoding validates and translates the chars with nibble
+   lookups, then packs 4 6-bit values into 3 bytes by multiply-adds; encoding spreads 3 bytes over 4
+   lanes by multiplies and translates with one lookup. The pshufb these need is in SSSE3, which
+   SSE4.2 implies. */
+SJSON_TARGET("sse4.2")
+static inline __m128i base64_values_sse42(__m128i v, int *valid) {
+   const __m128i lutLo=_mm_setr_epi8(0x15,0x11,0x11,0x11,0x11,0x11,0x11,0x11,0x11,0x11,0x13,0x1a,0x1b,0x1b,0x1b,0x1a);
+   const __m128i lutHi=_mm_setr_epi8(0x10,0x10,0x01,0x02,0x04,0x08,0x04,0x08,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x10);
+   const __m128i lutRoll=_mm_setr_epi8(0,16,19,4,-65,-65,-71,-71,0,0,0,0,0,0,0,0);
+   const __m128i mask2F=_mm_set1_epi8(0x2f);
+   __m128i hiNibbles=_mm_and_si128(_mm_srli_epi32(v,4),mask2F);
+   *valid=_mm_testz_si128(_mm_shuffle_epi8(lutLo,_mm_and_si128(v,mask2F)),_mm_shuffle_epi8(lutHi,hiNibbles));
+   v=_mm_add_epi8(v,_mm_shuffle_epi8(lutRoll,_mm_add_epi8(_mm_cmpeq_epi8(v,mask2F),hiNibbles)));
+   v=_mm_madd_epi16(_mm_maddubs_epi16(v,_mm_set1_epi32(0x01400140)),_mm_set1_epi32(0x00011000));
+   return _mm_shuffle_epi8(v,_mm_setr_epi8(2,1,0,6,5,4,10,9,8,14,13,12,-1,-1,-1,-1));
+}
+
+SJSON_TARGET("sse4.2")
+static int base64_decode_sse42(const char *src, size_t len, unsigned char *out) {
+   int valid;
+   for (;len>=24;len-=16,src+=16,out+=12) {     /* the 16 byte store needs 4 bytes of slack */
+      __m128i v=base64_values_sse42(_mm_loadu_si128((const __m128i*)src),&valid);
+      if (!valid)
+         return 0;
+      _mm_storeu_si128((__m128i*)out,v);
+   }
+   return base64_decode_scalar(src,len,out);
+}
+
+SJSON_TARGET("sse4.2")
+static inline __m128i base64_chars_sse42(__m128i v) {
+   const __m128i lut=_mm_setr_epi8(65,71,-4,-4,-4,-4,-4,-4,-4,-4,-4,-4,-19,-16,0,0);
+   __m128i indices;
+   v=_mm_shuffle_epi8(v,_mm_setr_epi8(1,0,2,1,4,3,5,4,7,6,8,7,10,9,11,10));
+   v=_mm_or_si128(_mm_mulhi_epu16(_mm_and_si128(v,_mm_set1_epi32(0x0fc0fc00)),_mm_set1_epi32(0x04000040)),
+      _mm_mullo_epi16(_mm_and_si128(v,_mm_set1_epi32(0x003f03f0)),_mm_set1_epi32(0x01000010)));
+   indices=_mm_sub_epi8(_mm_subs_epu8(v,_mm_set1_epi8(51)),_mm_cmpgt_epi8(v,_mm_set1_epi8(25)));
+   return _mm_add_epi8(v,_mm_shuffle_epi8(lut,indices));
+}
+
+SJSON_TARGET("sse4.2")
+static void base64_encode_sse42(const unsigned char *src, size_t size, char *out) {
+   for (;size>=16;size-=12,src+=12,out+=16)    /* loads 16 bytes for 12 */
+      _mm_storeu_si128((__m128i*)out,base64_chars_sse42(_mm_loadu_si128((const __m128i*)src)));
+   base64_encode_scalar(src,size,out);
+}
+
+SJSON_TARGET("avx2")
+static int base64_decode_avx2(const char *src, size_t len, unsigned char *out) {
+   const __m256i lutLo=_mm256_setr_epi8(0x15,0x11,0x11,0x11,0x11,0x11,0x11,0x11,0x11,0x11,0x13,0x1a,0x1b,0x1b,0x1b,0x1a,
+      0x15,0x11,0x11,0x11,0x11,0x11,0x11,0x11,0x11,0x11,0x13,0x1a,0x1b,0x1b,0x1b,0x1a);
+   const __m256i lutHi=_mm256_setr_epi8(0x10,0x10,0x01,0x02,0x04,0x08,0x04,0x08,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x10,
+      0x10,0x10,0x01,0x02,0x04,0x08,0x04,0x08,0x10,0x10,0x10,0x10,0x10,0x10,0x10,0x10);
+   const __m256i lutRoll=_mm256_setr_epi8(0,16,19,4,-65,-65,-71,-71,0,0,0,0,0,0,0,0,0,16,19,4,-65,-65,-71,-71,0,0,0,0,0,0,0,0);
+   const __m256i mask2F=_mm256_set1_epi8(0x2f);
+   const __m256i pack=_mm256_setr_epi8(2,1,0,6,5,4,10,9,8,14,13,12,-1,-1,-1,-1,2,1,0,6,5,4,10,9,8,14,13,12,-1,-1,-1,-1);
+   for (;len>=48;len-=32,src+=32,out+=24) {     /* the 32 byte store needs 8 bytes of slack */
+      __m256i v=_mm256_loadu_si256((const __m256i*)src);
+      __m256i hiNibbles=_mm256_and_si256(_mm256_srli_epi32(v,4),mask2F);
+      if (!_mm256_testz_si256(_mm256_shuffle_epi8(lutLo,_mm256_and_si256(v,mask2F)),_mm256_shuffle_epi8(lutHi,hiNibbles)))
+         return 0;
+      v=_mm256_add_epi8(v,_mm256_shuffle_epi8(lutRoll,_mm256_add_epi8(_mm256_cmpeq_epi8(v,mask2F),hiNibbles)));
+      v=_mm256_madd_epi16(_mm256_maddubs_epi16(v,_mm256_set1_epi32(0x01400140)),_mm256_set1_epi32(0x00011000));
+      v=_mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(v,pack),_mm256_setr_epi32(0,1,2,4,5,6,3,7));
+      _mm256_storeu_si256((__m256i*)out,v);
+   }
+   return base64_decode_scalar(src,len,out);
+}
+
+SJSON_TARGET("avx2")
+static void base64_encode_avx2(const unsigned char *src, size_t size, char *out) {
+   const __m256i lut=_mm256_setr_epi8(65,71,-4,-4,-4,-4,-4,-4,-4,-4,-4,-4,-19,-16,0,0,65,71,-4,-4,-4,-4,-4,-4,-4,-4,-4,-4,-19,-16,0,0);
+   const __m256i spread=_mm256_setr_epi8(1,0,2,1,4,3,5,4,7,6,8,7,10,9,11,10,1,0,2,1,4,3,5,4,7,6,8,7,10,9,11,10);
+   for (;size>=28;size-=24,src+=24,out+=32) {    /* 12 bytes per lane, the second load reads 16 */
+      __m256i v=_mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)src)),
+         _mm_loadu_si128((const __m128i*)(src+12)),1), indices;
+      v=_mm256_shuffle_epi8(v,spread);
+      v=_mm256_or_si256(_mm256_mulhi_epu16(_mm256_and_si256(v,_mm256_set1_epi32(0x0fc0fc00)),_mm256_set1_epi32(0x04000040)),
+         _mm256_mullo_epi16(_mm256_and_si256(v,_mm256_set1_epi32(0x003f03f0)),_mm256_set1_epi32(0x01000010)));
+      indices=_mm256_sub_epi8(_mm256_subs_epu8(v,_mm256_set1_epi8(51)),_mm256_cmpgt_epi8(v,_mm256_set1_epi8(25)));
+      _mm256_storeu_si256((__m256i*)out,_mm256_add_epi8(v,_mm256_shuffle_epi8(lut,indices)));
+   }
+   base64_encode_scalar(src,size,out);
+}
+
+static void cpuid(int leaf, int subleaf, unsigned regs[4]) {
+#ifdef _MSC_VER
+   __cpuidex((int*)regs,leaf,subleaf);
+#else
+   __cpuid_count(leaf,subleaf,regs[0],regs[1],regs[2],regs[3]);
+#endif
+}
+
+/* The register state the OS saves on context switches. */
+static uint64_t os_state() {
+#ifdef _MSC_VER
+   return _xgetbv(0);
+#else
+   unsigned lo, hi;
+   __asm__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+   return ((uint64_t)hi<<32)|lo;
+#endif
+}
+
+static int detect_level() {
+   unsigned regs[4];
+   uint64_t state;
+   cpuid(0,0,regs);
+   if (regs[0]<1)
+      return sJSON_CpuScalar;
+   unsigned maxLeaf=regs[0];
+   cpuid(1,0,regs);
+   if (!(regs[2]&(1u<<20)))       /* SSE4.2 */
+      return sJSON_CpuScalar;
+   if (!(regs[2]&(1u<<27)) || maxLeaf<7)     /* OSXSAVE */
+      return sJSON_CpuSSE42;
+   state=os_state();
+   cpuid(7,0,regs);
+   if ((state&0x6)!=0x6 || !(regs[1]&(1u<<5)))     /* XMM/YMM state, AVX2 */
+      return sJSON_CpuSSE42;
+   if ((state&0xe6)!=0xe6 || !(regs[1]&(1u<<16)) || !(regs[1]&(1u<<30)))    /* ZMM state, AVX-512 F and BW */
+      return sJSON_CpuAVX2;
+   return sJSON_CpuAVX512;
+}
+#else
+static int detect_level() {
+   return sJSON_CpuScalar;
+}
+#endif
+
+sJSON_Kernels sJSONkernels={scan_string_scalar,scan_plain_scalar,base64_decode_scalar,base64_encode_scalar};
+
+static int supported=-1, bound=sJSON_CpuScalar;
+
+int sJSONcpuSupported() {
+   if (supported<0)
+      supported=detect_level();
+   return supported;
+}
+
+int sJSONcpuLevel() {
+   return bound;
+}
+
+const char *sJSONcpuLevelName(int level) {
+   static const char *names[]={"scalar","sse4.2","avx2","avx512"};
+   return (level>=0 && level<=sJSON_CpuAVX512)?names[level]:0;
+}
+
+int sJSONcpuSetLevel(int level) {
+   if (level>sJSONcpuSupported())
+      level=supported;
+   if (level<sJSON_CpuScalar)
+      level=sJSON_CpuScalar;
+   sJSONkernels.scanString=scan_string_scalar;
+   sJSONkernels.scanPlain=scan_plain_scalar;
+   sJSONkernels.base64Decode=base64_decode_scalar;
+   sJSONkernels.base64Encode=base64_encode_scalar;
+#ifdef SJSON_X86
+   switch (level) {
+      case sJSON_CpuAVX512:      /* base64 stays on AVX2, the byte permutes it would want are VBMI */
+         sJSONkernels.scanString=scan_string_avx512;
+         sJSONkernels.scanPlain=scan_plain_avx512;
+         sJSONkernels.base64Decode=base64_decode_avx2;
+         sJSONkernels.base64Encode=base64_encode_avx2;
+         break;
+      case sJSON_CpuAVX2:
+         sJSONkernels.scanString=scan_string_avx2;
+         sJSONkernels.scanPlain=scan_plain_avx2;
+         sJSONkernels.base64Decode=base64_decode_avx2;
+         sJSONkernels.base64Encode=base64_encode_avx2;
+         break;
+      case sJSON_CpuSSE42:
+         sJSONkernels.scanString=scan_string_sse42;
+         sJSONkernels.scanPlain=scan_plain_sse42;
+         sJSONkernels.base64Decode=base64_decode_sse42;
+         sJSONkernels.base64Encode=base64_encode_sse42;
+         break;
+   }
+#endif
+   bound=level;
+   return level;
+}
+
+/* Bind at startup, below the cap of SJSON_CPU. A value that names no level is reported and taken as
+   scalar, a typo must not quietly leave the fastest kernels in place. */
+static int bind_kernels() {
+   const char *cap=getenv("SJSON_CPU");
+   int level=sJSON_CpuAVX512;
+   if (cap && *cap) {
+      while (level>=sJSON_CpuScalar && strcmp(cap,sJSONcpuLevelName(level)))
+         level--;
+      if (level<sJSON_CpuScalar) {
+         fprintf(stderr,"sjson: unknown SJSON_CPU \"%s\" (scalar, sse4.2, avx2 or avx512), using scalar\n",cap);
+         level=sJSON_CpuScalar;
+      }
+   }
+   return sJSONcpuSetLevel(level);
+}
+static int boundAtStartup=bind_kernels();
@@ -0,0 +1,62 @@
+/*
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef sJSONcpu__h
+#define sJSONcpu__h
+
+#include <stddef.h>
+
+/* Runtime dispatch of the vectorized kernels. The CPU is checked once at startup and every kernel
+   is bound to the best version it supports, so one binary runs on any x86-64 (and on other
+   architectures with the scalar versions). Set the environment variable SJSON_CPU to scalar,
+   sse4.2, avx2 or avx512 to cap the level, e.g. for testing the scalar path. Other values are
+   reported on stderr and select scalar. sjson-tool check tests every level the CPU supports. */
+
+/* Kernel levels, each one implies the ones below. */
+#define sJSON_CpuScalar 0
+#define sJSON_CpuSSE42 1
+#define sJSON_CpuAVX2 2
+#define sJSON_CpuAVX512 3     /* AVX-512 BW */
+
+typedef struct sJSON_Kernels {
+   /* First '"', '\\' or 0 from str on. Reads whole aligned vectors, never across a page end. */
+   const char *(*scanString)(const char *str);
+   /* First '"', '\\' or control char in [str,end), end if there is none. */
+   const char *(*scanPlain)(const char *str, const char *end);
+   /* Decode len base64 chars without padding (len%4 isn't 1) to len*3/4 bytes at out. 0 if a char
+      is outside the alphabet, out may be partly written then. */
+   int (*base64Decode)(const char *src, size_t len, unsigned char *out);
+   /* Encode size bytes as base64 with padding, (size+2)/3*4 chars at out, not 0-terminated. */
+   void (*base64Encode)(const unsigned char *src, size_t size, char *out);
+} sJSON_Kernels;
+
+/* The bound kernels, scalar until the startup check has run. */
+extern sJSON_Kernels sJSONkernels;
+
+/* The highest level the CPU (and OS) supports. */
+extern int sJSONcpuSupported();
+/* The level the kernels are bound to. */
+extern int sJSONcpuLevel();
+extern const char *sJSONcpuLevelName(int level);
+/* Rebind the kernels for level, capped to the supported one, and return the level bound. Not safe
+   while other threads are parsing or printing. */
+extern int sJSONcpuSetLevel(int level);
+
+#endif
@@ -0,0 +1,277 @@
+/*
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* sJSON include directive. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "murmurhash.h"
+#include "sjsoninclude.h"
+
+/* A file parsed for the set, kept until the set is deleted. */
+typedef struct sJSON_Included {
+   struct sJSON_Included *next;
+   char *path;          /* canonical */
+   uint32_t pathHash;
+   sJSON *root;         /* 0 while its own includes are being resolved */
+} sJSON_Included;
+
+struct sJSON_Includes {
+   sJSON_Included *files;
+   sJSON_ParseOptions options;
+   uint32_t keyHash;
+   char *errorPath;
+};
+
+static char *include_strdup(const char *str, size_t len) {
+   char *copy=(char*)sJSONmalloc(len+1);
+   if (copy) {
+      memcpy(copy,str,len);
+      copy[len]=0;
+   }
+   return copy;
+}
+
+static void set_error(sJSON_Includes *includes, const char *path) {
+   sJSONfree(includes->errorPath);
+   includes->errorPath=include_strdup(path,strlen(path));
+}
+
+sJSON_Includes *sJSONincludesCreate(const char *key, const sJSON_ParseOptions *options) {
+   sJSON_Includes *includes=(sJSON_Includes*)sJSONmalloc(sizeof(sJSON_Includes));
+   if (!includes)
+      return 0;
+   memset(includes,0,sizeof(sJSON_Includes));
+   if (options)
+      includes->options=*options;
+   includes->options.flags&=~(sJSON_ParseLazyNumbers|sJSON_ParseLazyStrings);   /* the texts aren't kept */
+   includes->options.spans=0;
+   includes->keyHash=eastl::murmurString(key?key:"#include");
+   return includes;
+}
+
+void sJSONincludesDelete(sJSON_Includes *includes) {
+   sJSON_Included *file, *next;
+   if (!includes)
+      return;
+   for (file=includes->files;file;file=next) {
+      next=file->next;
+      sJSONdelete(file->root);
+      sJSONfree(file->path);
+      sJSONfree(file);
+   }
+   sJSONfree(includes->errorPath);
+   sJSONfree(includes);
+}
+
+const char *sJSONincludesErrorPath(const sJSON_Includes *includes) {
+   return includes->errorPath;
+}
+
+/* Read and parse a file, 0 if it can't be. */
+static sJSON *parse_file(sJSON_Includes *includes, const char *path) {
+   struct stat info;
+   sJSON *root=0;
+   size_t done=0;
+   char *text;
+   int fd=open(path,O_RDONLY);
+   if (fd<0)
+      return 0;
+   if (fstat(fd,&info)<0 || !(text=(char*)sJSONmalloc((size_t)info.st_size+1))) {
+      close(fd);
+      return 0;
+   }
+   while (done<(size_t)info.st_size) {
+      ssize_t got=read(fd,text+done,(size_t)info.st_size-done);
+      if (got<0 && errno==EINTR)
+         continue;
+      if (got<=0)
+         break;
+      done+=(size_t)got;
+   }
+   close(fd);
+   if (done==(size_t)info.st_size) {
+      text[done]=0;
+      root=sJSONparseWithOptions(text,&includes->options);
+   }
+   sJSONfree(text);
+   return root;
+}
+
+/* Length of the directory part of path, including the slash. */
+static size_t directory_length(const char *path) {
+   const char *slash=strrchr(path,'/');
+   return slash?(size_t)(slash-path)+1:0;
+}
+
+static sJSON *resolve_file(sJSON_Includes *includes, const char *path);
+
+/* Splice the members of the included file into object. */
+static int include_file(sJSON_Includes *includes, sJSON *object, const char *directory, const char *name) {
+   size_t dirLen=strlen(directory), nameLen=strlen(name);
+   char *path;
+   sJSON *root, *c;
+   if (name[0]=='/' || !dirLen) {
+      path=include_strdup(name,nameLen);
+   } else if ((path=(char*)sJSONmalloc(dirLen+nameLen+2))) {
+      memcpy(path,directory,dirLen);
+      if (directory[dirLen-1]!='/')
+         path[dirLen++]='/';
+      memcpy(path+dirLen,name,nameLen+1);
+   }
+   if (!path)
+      return 0;
+   root=resolve_file(includes,path);
+   sJSONfree(path);
+   if (!root)
+      return 0;
+   for (c=root->child;c;c=c->next)
+      if (!sJSONgetObjectItemFrom(object,c->nameHash,0) && !sJSONaddMemberReference(object,c))   /* keys present already win */
+         return 0;
+   return 1;
+}
+
+/* path is the file of the tree, reported for directives that aren't paths. */
+static int resolve_tree(sJSON_Includes *includes, sJSON *item, const char *directory, const char *path) {
+   for (;item;item=item->next) {
+      sJSON *c=item->child, *directive;
+      if (item->type&sJSON_IsReference)
+         continue;      /* included, resolved already */
+      if ((item->type&sJSON_TypeMask)==sJSON_Object) {
+         int which=0;
+         while (c && c->nameHash!=includes->keyHash) {
+            c=c->next;
+            which++;
+         }
+         while (c) {    /* every directive of the object */
+            directive=sJSONdetachItemFromArray(item,which);
+            c=directive->next;
+            if ((directive->type&sJSON_TypeMask)==sJSON_String) {
+               if (!include_file(includes,item,directory,sJSONgetString(directive))) {
+                  sJSONdelete(directive);
+                  return 0;
+               }
+            } else if ((directive->type&sJSON_TypeMask)==sJSON_Array) {
+               for (sJSON *p=directive->child;p;p=p->next) {
+                  if ((p->type&sJSON_TypeMask)!=sJSON_String)
+                     set_error(includes,path);
+                  if ((p->type&sJSON_TypeMask)!=sJSON_String || !include_file(includes,item,directory,sJSONgetString(p))) {
+                     sJSONdelete(directive);
+                     return 0;
+                  }
+               }
+            }
+            sJSONdelete(directive);
+            for (c=item->child,which=0;c && c->nameHash!=includes->keyHash;c=c->next)
+               which++;
+         }
+      }
+      if (!resolve_tree(includes,item->child,directory,path))
+         return 0;
+   }
+   return 1;
+}
+
+/* The resolved root object of the file, parsed on first use. */
+static sJSON *resolve_file(sJSON_Includes *includes, const char *path) {
+   char canonical[PATH_MAX];
+   sJSON_Included *file;
+   sJSON *root;
+   char *directory;
+   uint32_t hash;
+   if (!realpath(path,canonical)) {
+      set_error(includes,path);
+      return 0;
+   }
+   hash=eastl::murmurString(canonical);
+   for (file=includes->files;file;file=file->next)
+      if (file->pathHash==hash && !strcmp(file->path,canonical)) {
+         if (!file->root)
+            set_error(includes,path);   /* includes itself */
+         return file->root;
+      }
+
+   if (!(file=(sJSON_Included*)sJSONmalloc(sizeof(sJSON_Included))))
+      return 0;
+   if (!(file->path=include_strdup(canonical,strlen(canonical)))) {
+      sJSONfree(file);
+      return 0;
+   }
+   file->pathHash=hash;
+   file->root=0;
+   file->next=includes->files;
+   includes->files=file;
+
+   root=parse_file(includes,canonical);
+   if (!root || (root->type&sJSON_TypeMask)!=sJSON_Object) {
+      set_error(includes,path);
+      sJSONdelete(root);
+      root=0;
+   } else if (!(directory=include_strdup(canonical,directory_length(canonical)))) {
+      sJSONdelete(root);
+      root=0;
+   } else {
+      if (!resolve_tree(includes,root,directory,path)) {
+         sJSONdelete(root);
+         root=0;
+      }
+      sJSONfree(directory);
+   }
+   if (!root) {     /* forget the file, a later load may try again */
+      sJSON_Included **link=&includes->files;
+      while (*link!=file)
+         link=&(*link)->next;
+      *link=file->next;
+      sJSONfree(file->path);
+      sJSONfree(file);
+      return 0;
+   }
+   file->root=root;
+   return root;
+}
+
+int sJSONincludesResolve(sJSON_Includes *includes, sJSON *root, const char *directory) {
+   directory=directory?directory:"";
+   return resolve_tree(includes,root,directory,directory);
+}
+
+sJSON *sJSONincludesLoad(sJSON_Includes *includes, const char *path) {
+   sJSON *root=parse_file(includes,path);
+   char *directory;
+   if (!root) {
+      set_error(includes,path);
+      return 0;
+   }
+   if (!(directory=include_strdup(path,directory_length(path)))) {
+      sJSONdelete(root);
+      return 0;
+   }
+   if (!resolve_tree(includes,root,directory,path)) {
+      sJSONdelete(root);
+      root=0;
+   }
+   sJSONfree(directory);
+   return root;
+}
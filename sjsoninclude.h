@@ -0,0 +1,48 @@
+/*
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include "sjson.h"
+
+#ifndef sJSONinclude__h
+#define sJSONinclude__h
+
+/* Include directive: a member like
+      "#include" = "common.sjson"      (or an array of paths)
+   is replaced by the members of the root object of that file. Paths are relative to the including
+   file. Every file is parsed once per include set and shared: the including objects get references
+   to its members, not copies. Keys the including object has already, of its own or from an earlier
+   include, are skipped. Included files may include further files, but not in a
+   cycle. */
+
+typedef struct sJSON_Includes sJSON_Includes;
+
+/* key is the directive key, 0 for "#include". The lazy flags of options are ignored. */
+extern sJSON_Includes *sJSONincludesCreate(const char *key, const sJSON_ParseOptions *options);
+/* Release the included trees. Delete the documents that include them first. */
+extern void   sJSONincludesDelete(sJSON_Includes *includes);
+/* Parse the file at path and resolve its includes. The caller owns the tree. 0 on failure. */
+extern sJSON *sJSONincludesLoad(sJSON_Includes *includes, const char *path);
+/* Resolve the includes of a parsed tree, with paths relative to directory. 0 on failure. */
+extern int    sJSONincludesResolve(sJSON_Includes *includes, sJSON *root, const char *directory);
+/* The file that failed the last load or resolve: not readable, not parsed, included in a cycle, or
+   listing an include that isn't a path (for a tree given to sJSONincludesResolve: its directory). */
+extern const char *sJSONincludesErrorPath(const sJSON_Includes *includes);
+
+#endif
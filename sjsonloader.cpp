@@ -0,0 +1,319 @@
+/*
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* sJSON bulk file loader. */
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "sjsonloader.h"
+
+#ifdef THREAD_SUPPORT_ENABLED
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#ifdef SJSON_USE_IO_URING
+   #include <liburing.h>
+   #define SJSON_LOADER_QUEUE_DEPTH 64       /* reads in flight on the ring */
+#endif
+#define SJSON_LOADER_MAX_READ (1<<30)       /* bytes per read call */
+
+/* A queued file, passed from the read queue to the parse queue. */
+typedef struct sJSON_LoadJob {
+   struct sJSON_LoadJob *next;
+   char *path;
+   sJSON_LoadCallback callback;
+   void *user;
+   char *text;
+   size_t size, done;
+   int fd, error;
+} sJSON_LoadJob;
+
+typedef struct loadqueue {
+   sJSON_LoadJob *head, *tail;
+} loadqueue;
+
+struct sJSON_Loader {
+   std::mutex lock;
+   std::condition_variable readable, parseable, idle;
+   loadqueue reads, parses;
+   size_t pending;            /* queued files whose callback hasn't returned yet */
+   bool stop;
+   int flags;
+   int numThreads;
+   std::thread *threads;
+#ifdef SJSON_USE_IO_URING
+   struct io_uring ring;
+   bool useRing;
+#endif
+};
+
+static void push_job(loadqueue *queue, sJSON_LoadJob *job) {
+   job->next=0;
+   if (queue->tail)
+      queue->tail->next=job;
+   else
+      queue->head=job;
+   queue->tail=job;
+}
+
+static sJSON_LoadJob *pop_job(loadqueue *queue) {
+   sJSON_LoadJob *job=queue->head;
+   if (job && !(queue->head=job->next))
+      queue->tail=0;
+   return job;
+}
+
+/* Open the file and allocate its buffer, 0 with job->error set on failure. */
+static int open_file(sJSON_LoadJob *job) {
+   struct stat info;
+   if ((job->fd=open(job->path,O_RDONLY))<0) {   /* fd stays -1 */
+      job->error=errno;
+      return 0;
+   }
+   if (fstat(job->fd,&info)<0)
+      job->error=errno;
+   else if (!(job->text=(char*)sJSONmalloc((size_t)info.st_size+1)))
+      job->error=ENOMEM;
+   if (job->error) {
+      close(job->fd);
+      job->fd=-1;
+      return 0;
+   }
+   job->size=(size_t)info.st_size;
+   job->done=0;
+   return 1;
+}
+
+/* Close the file and hand the job over to the parse threads. */
+static void finish_read(sJSON_Loader *loader, sJSON_LoadJob *job) {
+   if (job->fd>=0)
+      close(job->fd);
+   if (job->error) {
+      sJSONfree(job->text);
+      job->text=0;
+      job->size=0;
+   } else {
+      job->size=job->done;    /* the file may have shrunk */
+      job->text[job->size]=0;
+   }
+   std::lock_guard<std::mutex> guard(loader->lock);
+   push_job(&loader->parses,job);
+   loader->parseable.notify_one();
+}
+
+static sJSON_LoadJob *next_read(sJSON_Loader *loader) {
+   std::unique_lock<std::mutex> guard(loader->lock);
+   loader->readable.wait(guard,[loader]{return loader->stop || loader->reads.head;});
+   return pop_job(&loader->reads);
+}
+
+/* Read thread: whole files with pread. */
+static void read_files(sJSON_Loader *loader) {
+   sJSON_LoadJob *job;
+   while ((job=next_read(loader))) {
+      if (open_file(job))
+         while (job->done<job->size) {
+            size_t len=job->size-job->done;
+            ssize_t got=pread(job->fd,job->text+job->done,(len>SJSON_LOADER_MAX_READ)?SJSON_LOADER_MAX_READ:len,(off_t)job->done);
+            if (got<0 && errno==EINTR)
+               continue;
+            if (got<0)
+               job->error=errno;
+            if (got<=0)
+               break;
+            job->done+=(size_t)got;
+         }
+      finish_read(loader,job);
+   }
+}
+
+#ifdef SJSON_USE_IO_URING
+static void submit_read(sJSON_Loader *loader, sJSON_LoadJob *job) {
+   struct io_uring_sqe *sqe=io_uring_get_sqe(&loader->ring);
+   size_t len=job->size-job->done;
+   io_uring_prep_read(sqe,job->fd,job->text+job->done,(unsigned)((len>SJSON_LOADER_MAX_READ)?SJSON_LOADER_MAX_READ:len),job->done);
+   io_uring_sqe_set_data(sqe,job);
+}
+
+/* The one read thread with io_uring: keeps up to SJSON_LOADER_QUEUE_DEPTH reads in flight. */
+static void ring_files(sJSON_Loader *loader) {
+   unsigned inflight=0;
+   for (;;) {
+      loadqueue batch={0,0};
+      sJSON_LoadJob *job;
+      {
+         std::unique_lock<std::mutex> guard(loader->lock);
+         if (!inflight)
+            loader->readable.wait(guard,[loader]{return loader->stop || loader->reads.head;});
+         if (!inflight && !loader->reads.head)
+            return;     /* stopped */
+         while (inflight<SJSON_LOADER_QUEUE_DEPTH && (job=pop_job(&loader->reads))) {
+            push_job(&batch,job);
+            inflight++;
+         }
+      }
+      while ((job=pop_job(&batch))) {
+         if (open_file(job) && job->size) {
+            submit_read(loader,job);
+         } else {
+            inflight--;
+            finish_read(loader,job);
+         }
+      }
+      io_uring_submit(&loader->ring);
+      if (!inflight)
+         continue;
+
+      struct io_uring_cqe *cqe;
+      int res=io_uring_wait_cqe(&loader->ring,&cqe);
+      if (res<0)
+         continue;   /* interrupted */
+      do {
+         job=(sJSON_LoadJob*)io_uring_cqe_get_data(cqe);
+         res=cqe->res;
+         io_uring_cqe_seen(&loader->ring,cqe);
+         if (res==-EINTR || res==-EAGAIN) {
+            submit_read(loader,job);
+            continue;
+         }
+         if (res<0)
+            job->error=-res;
+         else
+            job->done+=(size_t)res;
+         if (res>0 && job->done<job->size) {
+            submit_read(loader,job);
+         } else {
+            inflight--;
+            finish_read(loader,job);
+         }
+      } while (io_uring_peek_cqe(&loader->ring,&cqe)==0);
+      io_uring_submit(&loader->ring);
+   }
+}
+#endif
+
+/* Parse thread. */
+static void parse_files(sJSON_Loader *loader) {
+   sJSON_ParseOptions options;
+   memset(&options,0,sizeof(options));
+   options.flags=loader->flags;
+   for (;;) {
+      sJSON_LoadJob *job;
+      {
+         std::unique_lock<std::mutex> guard(loader->lock);
+         loader->parseable.wait(guard,[loader]{return loader->stop || loader->parses.head;});
+         if (!(job=pop_job(&loader->parses)))
+            return;
+      }
+      sJSON *root=job->error?0:sJSONparseWithOptions(job->text,&options);
+      job->callback(job->user,job->path,root,job->text,job->size,job->error);
+      sJSONfree(job->path);
+      sJSONfree(job);
+      std::lock_guard<std::mutex> guard(loader->lock);
+      if (!--loader->pending)
+         loader->idle.notify_all();
+   }
+}
+
+sJSON_Loader *sJSONloaderCreate(int numThreads, const sJSON_ParseOptions *options) {
+   sJSON_Loader *loader=new sJSON_Loader;
+   int i, numReaders;
+   if (numThreads<=0)
+      numThreads=(int)std::thread::hardware_concurrency();
+   if (numThreads<=0)
+      numThreads=1;
+   loader->reads.head=loader->reads.tail=0;
+   loader->parses.head=loader->parses.tail=0;
+   loader->pending=0;
+   loader->stop=false;
+   loader->flags=options?options->flags:0;
+   numReaders=numThreads;
+#ifdef SJSON_USE_IO_URING
+   loader->useRing=io_uring_queue_init(SJSON_LOADER_QUEUE_DEPTH,&loader->ring,0)==0;
+   if (loader->useRing)
+      numReaders=1;     /* otherwise fall back to pread */
+#endif
+   loader->numThreads=numThreads+numReaders;
+   loader->threads=new std::thread[loader->numThreads];
+   for (i=0;i<numThreads;i++)
+      loader->threads[i]=std::thread(parse_files,loader);
+   for (;i<loader->numThreads;i++) {
+#ifdef SJSON_USE_IO_URING
+      if (loader->useRing) {
+         loader->threads[i]=std::thread(ring_files,loader);
+         continue;
+      }
+#endif
+      loader->threads[i]=std::thread(read_files,loader);
+   }
+   return loader;
+}
+
+int sJSONloaderAdd(sJSON_Loader *loader, const char *path, sJSON_LoadCallback callback, void *user) {
+   size_t len=strlen(path)+1;
+   sJSON_LoadJob *job=(sJSON_LoadJob*)sJSONmalloc(sizeof(sJSON_LoadJob));
+   if (!job)
+      return 0;
+   memset(job,0,sizeof(sJSON_LoadJob));
+   if (!(job->path=(char*)sJSONmalloc(len))) {
+      sJSONfree(job);
+      return 0;
+   }
+   memcpy(job->path,path,len);
+   job->callback=callback;
+   job->user=user;
+   job->fd=-1;
+   std::lock_guard<std::mutex> guard(loader->lock);
+   push_job(&loader->reads,job);
+   loader->pending++;
+   loader->readable.notify_one();
+   return 1;
+}
+
+void sJSONloaderWait(sJSON_Loader *loader) {
+   std::unique_lock<std::mutex> guard(loader->lock);
+   loader->idle.wait(guard,[loader]{return !loader->pending;});
+}
+
+void sJSONloaderDelete(sJSON_Loader *loader) {
+   int i;
+   if (!loader)
+      return;
+   sJSONloaderWait(loader);
+   {
+      std::lock_guard<std::mutex> guard(loader->lock);
+      loader->stop=true;
+      loader->readable.notify_all();
+      loader->parseable.notify_all();
+   }
+   for (i=0;i<loader->numThreads;i++)
+      loader->threads[i].join();
+   delete[] loader->threads;
+#ifdef SJSON_USE_IO_URING
+   if (loader->useRing)
+      io_uring_queue_exit(&loader->ring);
+#endif
+   delete loader;
+}
+#endif
@@ -0,0 +1,50 @@
+/*
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include "sjson.h"
+
+#ifndef sJSONloader__h
+#define sJSONloader__h
+
+#ifdef THREAD_SUPPORT_ENABLED
+/* Bulk loading of files. Reads run on I/O threads (or through one io_uring, when built with
+   SJSON_USE_IO_URING and the kernel supports it), parses on worker threads, so reading the next
+   files overlaps with parsing the ones already read. */
+
+/* Called on a parse thread for every file. root is 0 if the file couldn't be read (error is the
+   errno then) or parsed (error is 0, sJSONgetErrorPtr tells where). The callback owns root and text,
+   the 0-terminated file contents which are released with the free hook; trees parsed with lazy
+   flags point into text. */
+typedef void (*sJSON_LoadCallback)(void *user, const char *path, sJSON *root, char *text, size_t size, int error);
+
+typedef struct sJSON_Loader sJSON_Loader;
+
+/* numThreads parse threads (0 for one per core) and as many read threads. Only the flags of options
+   are used, the tables it may point to aren't thread safe. */
+extern sJSON_Loader *sJSONloaderCreate(int numThreads, const sJSON_ParseOptions *options);
+/* Queue a file, 0 on memory fail. */
+extern int  sJSONloaderAdd(sJSON_Loader *loader, const char *path, sJSON_LoadCallback callback, void *user);
+/* Wait until the callbacks of all queued files have returned. */
+extern void sJSONloaderWait(sJSON_Loader *loader);
+/* Wait, then stop the threads. */
+extern void sJSONloaderDelete(sJSON_Loader *loader);
+#endif
+
+#endif
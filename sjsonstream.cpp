@@ -0,0 +1,619 @@
+/*
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* sJSON stream reader. */
+
+#include <string.h>
+#include <stdio.h>
+#include "sjsonstream.h"
+
+#ifdef SJSON_USE_ZLIB
+   #include <zlib.h>
+#endif
+#ifdef SJSON_USE_ZSTD
+   #include <zstd.h>
+#endif
+#ifdef THREAD_SUPPORT_ENABLED
+   #include <thread>
+   #include <mutex>
+   #include <condition_variable>
+#endif
+
+#define SJSON_STREAM_BLOCK (64*1024)     /* read size, and the first buffer size */
+
+/* Record scanner: finds where the next record ends without parsing it. It only tracks strings,
+   comments and bracket depth, plus the key/separator/value steps at the top level, where scalars
+   end without a closing character. */
+#define SCAN_KEY 0
+#define SCAN_IDENT 1
+#define SCAN_SEP 2
+#define SCAN_VALUE 3
+#define SCAN_SCALAR 4
+
+#define MODE_UNKNOWN 0
+#define MODE_MEMBERS 1
+#define MODE_ELEMENTS 2
+
+#define COMMENT_LINE 1
+#define COMMENT_BLOCK 2
+
+struct sJSON_Stream {
+   sJSON_StreamRead read;
+   void *user;
+   void (*close)(void *user);    /* for sources opened by the stream */
+   char *buffer;                 /* holds the text from the start of the current record */
+   size_t size, start, scan, end;
+   int mode, state, depth, inString, escape, comment, braced;
+   int eof, finished, error;
+   char *path;                   /* member names left to descend into, '.' separated */
+   size_t keyLength;             /* of the current member's key, from start on */
+   int skip;                     /* the current member isn't selected, its text can go */
+   sJSON_ParseOptions options;
+};
+
+sJSON_Stream *sJSONstreamCreate(sJSON_StreamRead read, void *user, const sJSON_ParseOptions *options) {
+   sJSON_Stream *stream=(sJSON_Stream*)sJSONmalloc(sizeof(sJSON_Stream));
+   if (!stream)
+      return 0;
+   memset(stream,0,sizeof(sJSON_Stream));
+   if (!(stream->buffer=(char*)sJSONmalloc(SJSON_STREAM_BLOCK+1))) {
+      sJSONfree(stream);
+      return 0;
+   }
+   stream->size=SJSON_STREAM_BLOCK+1;
+   stream->buffer[0]=0;
+   stream->read=read;
+   stream->user=user;
+   if (options)
+      stream->options=*options;
+   stream->options.flags&=~(sJSON_ParseLazyNumbers|sJSON_ParseLazyStrings);
+   stream->options.spans=0;
+   return stream;
+}
+
+void sJSONstreamDelete(sJSON_Stream *stream) {
+   if (!stream)
+      return;
+   if (stream->close)
+      stream->close(stream->user);
+   sJSONfree(stream->path);
+   sJSONfree(stream->buffer);
+   sJSONfree(stream);
+}
+
+int sJSONstreamSelect(sJSON_Stream *stream, const char *path) {
+   size_t len=strlen(path)+1;
+   char *copy;
+   if (stream->mode!=MODE_UNKNOWN || !(copy=(char*)sJSONmalloc(len)))
+      return 0;
+   memcpy(copy,path,len);
+   sJSONfree(stream->path);
+   stream->path=copy;
+   return 1;
+}
+
+int sJSONstreamError(const sJSON_Stream *stream) {
+   return stream->error;
+}
+
+int sJSONstreamIsArray(const sJSON_Stream *stream) {
+   return stream->mode==MODE_ELEMENTS;
+}
+
+/* Read more text behind what is buffered, dropping the records already handed out. */
+static void fill(sJSON_Stream *stream) {
+   size_t got;
+   if (stream->skip)
+      stream->start=stream->scan;
+   if (stream->start) {
+      memmove(stream->buffer,stream->buffer+stream->start,stream->end-stream->start);
+      stream->scan-=stream->start;
+      stream->end-=stream->start;
+      stream->start=0;
+   }
+   if (stream->size-stream->end<SJSON_STREAM_BLOCK/2+1) {   /* a big record, grow */
+      char *buffer=(char*)sJSONmalloc(stream->size*2);
+      if (!buffer) {
+         stream->error=sJSON_StreamNoMemory;
+         return;
+      }
+      memcpy(buffer,stream->buffer,stream->end);
+      sJSONfree(stream->buffer);
+      stream->buffer=buffer;
+      stream->size*=2;
+   }
+   got=stream->read(stream->user,stream->buffer+stream->end,stream->size-1-stream->end);
+   if (got==(size_t)-1)
+      stream->error=sJSON_StreamReadError;
+   else if (!got)
+      stream->eof=1;
+   else
+      stream->end+=got;
+   stream->buffer[stream->end]=0;   /* the scanner may look one char ahead */
+}
+
+static int is_ident(char c) {
+   return c=='_' || (c>='a' && c<='z') || (c>='A' && c<='Z') || (c>='0' && c<='9');
+}
+
+/* Whether the key of the current member is the next name of the path. */
+static int selected(const sJSON_Stream *s) {
+   const char *key=s->buffer+s->start, *name=s->path;
+   size_t len=s->keyLength, nameLen=strcspn(name,".");
+   if (len>=2 && *key=='\"') {
+      key++;
+      len-=2;
+   }
+   return len==nameLen && !memcmp(key,name,len);
+}
+
+/* Enter the container of the selected member at s->scan: its elements or members become the
+   records, and the rest of the text is never looked at. */
+static void descend(sJSON_Stream *s, char c) {
+   const char *rest=s->path+strcspn(s->path,".");
+   if (*rest=='.')
+      rest++;
+   memmove(s->path,rest,strlen(rest)+1);
+   s->mode=(c=='[')?MODE_ELEMENTS:MODE_MEMBERS;
+   s->state=(c=='[')?SCAN_VALUE:SCAN_KEY;
+   s->braced=1;
+   s->start=++s->scan;
+}
+
+/* Advance the scan, 1 when it reached the end of a record. */
+static int scan_record(sJSON_Stream *s) {
+   char *b=s->buffer;
+   while (s->scan<s->end) {
+      char c=b[s->scan];
+      if (s->comment==COMMENT_LINE) {
+         if (c=='\n' || c=='\r')
+            s->comment=0;
+         s->scan++;
+         continue;
+      }
+      if (s->comment==COMMENT_BLOCK) {
+         if (c=='*' && s->scan+1==s->end && !s->eof)
+            return 0;      /* need the next char */
+         if (c=='*' && b[s->scan+1]=='/') {
+            s->comment=0;
+            s->scan++;
+         }
+         s->scan++;
+         continue;
+      }
+      if (s->inString) {
+         if (s->escape)
+            s->escape=0;
+         else if (c=='\\')
+            s->escape=1;
+         else if (c=='\"') {
+            s->inString=0;
+            if (!s->depth) {
+               if (s->state!=SCAN_KEY) {
+                  s->scan++;
+                  return 1;
+               }
+               s->state=SCAN_SEP;
+               s->keyLength=s->scan+1-s->start;
+            }
+         }
+         s->scan++;
+         continue;
+      }
+      if (c=='/') {
+         if (s->scan+1==s->end && !s->eof)
+            return 0;
+         if (b[s->scan+1]=='/' || b[s->scan+1]=='*') {
+            if (!s->depth && s->state==SCAN_SCALAR)
+               return 1;
+            if (s->state==SCAN_IDENT) {
+               s->state=SCAN_SEP;
+               s->keyLength=s->scan-s->start;
+            }
+            s->comment=(b[s->scan+1]=='/')?COMMENT_LINE:COMMENT_BLOCK;
+            s->scan+=2;
+            continue;
+         }
+      }
+      if (s->depth) {
+         if (c=='\"')
+            s->inString=1;
+         else if (c=='{' || c=='[')
+            s->depth++;
+         else if ((c=='}' || c==']') && !--s->depth) {
+            s->scan++;
+            return 1;
+         }
+         s->scan++;
+         continue;
+      }
+      if (s->mode==MODE_UNKNOWN && (unsigned char)c>32) {
+         s->mode=(c=='[')?MODE_ELEMENTS:MODE_MEMBERS;
+         if (c=='[' || c=='{') {
+            s->braced=1;
+            s->state=(c=='[')?SCAN_VALUE:SCAN_KEY;
+            s->start=++s->scan;
+            continue;
+         }
+      }
+      switch (s->state) {
+         case SCAN_KEY:
+            if ((unsigned char)c<=32 || c==',') {
+               s->start=s->scan+1;     /* not part of the record */
+               break;
+            }
+            if (c=='}' && s->braced) {
+               s->finished=1;
+               return 0;
+            }
+            if (c=='\"')
+               s->inString=1;
+            else if (is_ident(c))
+               s->state=SCAN_IDENT;
+            else {
+               s->error=sJSON_StreamMalformed;
+               return 0;
+            }
+            s->start=s->scan;    /* drop comments before the key */
+            break;
+         case SCAN_IDENT:
+            if (is_ident(c))
+               break;
+            s->state=SCAN_SEP;
+            s->keyLength=s->scan-s->start;
+            continue;
+         case SCAN_SEP:
+            if ((unsigned char)c<=32)
+               break;
+            if (c!=':' && c!='=') {
+               s->error=sJSON_StreamMalformed;
+               return 0;
+            }
+            s->state=SCAN_VALUE;
+            if (s->path && *s->path)
+               s->skip=!selected(s);
+            break;
+         case SCAN_VALUE:
+            if (s->mode==MODE_ELEMENTS && ((unsigned char)c<=32 || c==',')) {
+               s->start=s->scan+1;
+               break;
+            }
+            if ((unsigned char)c<=32)
+               break;
+            if (c==']' && s->mode==MODE_ELEMENTS) {
+               s->finished=1;
+               return 0;
+            }
+            if (s->path && *s->path && (s->mode==MODE_ELEMENTS || !s->skip)) {
+               if (s->mode==MODE_ELEMENTS || (c!='{' && c!='[')) {
+                  s->error=sJSON_StreamNotFound;   /* the path leads through an array or to a scalar */
+                  return 0;
+               }
+               descend(s,c);
+               continue;
+            }
+            if (c=='{' || c=='[')
+               s->depth=1;
+            else if (c=='\"')
+               s->inString=1;
+            else
+               s->state=SCAN_SCALAR;
+            break;
+         case SCAN_SCALAR:
+            if (is_ident(c) || c=='.' || c=='+' || c=='-')
+               break;
+            return 1;
+      }
+      s->scan++;
+   }
+   return s->eof && s->state==SCAN_SCALAR;
+}
+
+/* The records ended: an error if that was before the selected path was found. */
+static int records_ended(sJSON_Stream *stream) {
+   if (!stream->error && stream->path && *stream->path)
+      stream->error=sJSON_StreamNotFound;
+   return 0;
+}
+
+/* Scan up to the end of the next record on the path. 0 at the end or on error. */
+static int next_record(sJSON_Stream *stream) {
+   for (;;) {
+      while (!scan_record(stream)) {
+         if (stream->error)
+            return 0;
+         if (stream->finished)
+            return records_ended(stream);
+         if (stream->eof) {   /* the end, fine unless in the middle of a record */
+            if (stream->inString || stream->depth || stream->comment==COMMENT_BLOCK
+               || stream->state!=((stream->mode==MODE_ELEMENTS)?SCAN_VALUE:SCAN_KEY))
+               stream->error=sJSON_StreamMalformed;
+            stream->finished=1;
+            return records_ended(stream);
+         }
+         fill(stream);
+      }
+      if (!stream->path || !*stream->path)
+         return 1;
+      stream->skip=0;      /* a record off the path */
+      stream->state=(stream->mode==MODE_ELEMENTS)?SCAN_VALUE:SCAN_KEY;
+      stream->start=stream->scan;
+   }
+}
+
+sJSON *sJSONstreamNext(sJSON_Stream *stream) {
+   sJSON *item;
+   char *text, save;
+   if (!next_record(stream))
+      return 0;
+   text=stream->buffer+stream->start;
+   save=stream->buffer[stream->scan];
+   stream->buffer[stream->scan]=0;
+   if (stream->mode==MODE_ELEMENTS) {
+      item=sJSONparseValue(text,&stream->options,0);
+      stream->state=SCAN_VALUE;
+   } else {
+      sJSON *root=sJSONparseWithOptions(text,&stream->options);
+      item=root?sJSONdetachItemFromArray(root,0):0;
+      sJSONdelete(root);
+      stream->state=SCAN_KEY;
+   }
+   stream->buffer[stream->scan]=save;
+   stream->start=stream->scan;
+   if (!item)
+      stream->error=sJSON_StreamMalformed;
+   return item;
+}
+
+int sJSONstreamEach(sJSON_Stream *stream, sJSON_StreamCallback callback, void *user) {
+   sJSON_Arena *arena=sJSONarenaCreate(SJSON_STREAM_BLOCK), *own=stream->options.arena;
+   sJSON *record;
+   int more=1;
+   if (!arena) {
+      stream->error=sJSON_StreamNoMemory;
+      return 0;
+   }
+   stream->options.arena=arena;
+   while (more && (record=sJSONstreamNext(stream))) {
+      more=callback(user,record);
+      sJSONdelete(record);    /* releases what lives outside the arena, like print caches */
+      sJSONarenaReset(arena);
+   }
+   stream->options.arena=own;
+   sJSONarenaDelete(arena);
+   return !stream->error;
+}
+
+/* File sources. */
+#define SOURCE_PLAIN 0
+#define SOURCE_GZIP 1
+#define SOURCE_ZSTD 2
+
+typedef struct filesource {
+   FILE *file;
+#ifdef SJSON_USE_ZLIB
+   gzFile gz;
+#endif
+#ifdef SJSON_USE_ZSTD
+   ZSTD_DStream *zstd;
+   ZSTD_inBuffer input;
+   char *in;
+#endif
+} filesource;
+
+static size_t read_plain(void *user, char *buffer, size_t size) {
+   filesource *source=(filesource*)user;
+   size_t got=fread(buffer,1,size,source->file);
+   return (!got && ferror(source->file))?(size_t)-1:got;
+}
+
+#ifdef SJSON_USE_ZLIB
+static size_t read_gzip(void *user, char *buffer, size_t size) {
+   int got=gzread(((filesource*)user)->gz,buffer,(unsigned)size);
+   return (got<0)?(size_t)-1:(size_t)got;
+}
+#endif
+
+#ifdef SJSON_USE_ZSTD
+static size_t read_zstd(void *user, char *buffer, size_t size) {
+   filesource *source=(filesource*)user;
+   ZSTD_outBuffer output={buffer,size,0};
+   while (!output.pos) {
+      if (source->input.pos==source->input.size) {
+         source->input.size=fread(source->in,1,ZSTD_DStreamInSize(),source->file);
+         source->input.pos=0;
+         if (!source->input.size)
+            return ferror(source->file)?(size_t)-1:0;
+      }
+      if (ZSTD_isError(ZSTD_decompressStream(source->zstd,&output,&source->input)))
+         return (size_t)-1;
+   }
+   return output.pos;
+}
+#endif
+
+static void close_file(void *user) {
+   filesource *source=(filesource*)user;
+#ifdef SJSON_USE_ZLIB
+   if (source->gz)
+      gzclose(source->gz);
+#endif
+#ifdef SJSON_USE_ZSTD
+   if (source->zstd)
+      ZSTD_freeDStream(source->zstd);
+   sJSONfree(source->in);
+#endif
+   if (source->file)
+      fclose(source->file);
+   sJSONfree(source);
+}
+
+#ifdef THREAD_SUPPORT_ENABLED
+/* Read-ahead: a thread fills two blocks from the inner source while the stream parses. */
+typedef struct readahead {
+   sJSON_StreamRead read;
+   void *user;
+   void (*close)(void *user);
+   std::thread thread;
+   std::mutex lock;
+   std::condition_variable changed;
+   char *blocks[2];
+   size_t lengths[2];            /* (size_t)-1 on error, 0 at the end */
+   bool filled[2], stop;
+   int current;
+   size_t pos;
+} readahead;
+
+static void read_ahead(readahead *ahead) {
+   int next=0;
+   for (;;) {
+      {
+         std::unique_lock<std::mutex> guard(ahead->lock);
+         ahead->changed.wait(guard,[ahead,next]{return ahead->stop || !ahead->filled[next];});
+         if (ahead->stop)
+            return;
+      }
+      size_t got=ahead->read(ahead->user,ahead->blocks[next],SJSON_STREAM_BLOCK);
+      std::lock_guard<std::mutex> guard(ahead->lock);
+      ahead->lengths[next]=got;
+      ahead->filled[next]=true;
+      ahead->changed.notify_all();
+      if (!got || got==(size_t)-1)
+         return;
+      next^=1;
+   }
+}
+
+static size_t read_buffered(void *user, char *buffer, size_t size) {
+   readahead *ahead=(readahead*)user;
+   size_t length;
+   {
+      std::unique_lock<std::mutex> guard(ahead->lock);
+      ahead->changed.wait(guard,[ahead]{return ahead->filled[ahead->current];});
+   }
+   length=ahead->lengths[ahead->current];
+   if (!length || length==(size_t)-1)
+      return length;
+   if (size>length-ahead->pos)
+      size=length-ahead->pos;
+   memcpy(buffer,ahead->blocks[ahead->current]+ahead->pos,size);
+   if ((ahead->pos+=size)==length) {
+      std::lock_guard<std::mutex> guard(ahead->lock);
+      ahead->filled[ahead->current]=false;
+      ahead->current^=1;
+      ahead->pos=0;
+      ahead->changed.notify_all();
+   }
+   return size;
+}
+
+static void close_buffered(void *user) {
+   readahead *ahead=(readahead*)user;
+   {
+      std::lock_guard<std::mutex> guard(ahead->lock);
+      ahead->stop=true;
+      ahead->changed.notify_all();
+   }
+   ahead->thread.join();
+   ahead->close(ahead->user);
+   sJSONfree(ahead->blocks[0]);
+   delete ahead;
+}
+#endif
+
+sJSON_Stream *sJSONstreamOpen(const char *path, const sJSON_ParseOptions *options) {
+   unsigned char magic[4]={0,0,0,0};
+   sJSON_StreamRead read=read_plain;
+   sJSON_Stream *stream;
+   filesource *source=(filesource*)sJSONmalloc(sizeof(filesource));
+   int kind=SOURCE_PLAIN;
+   if (!source)
+      return 0;
+   memset(source,0,sizeof(filesource));
+   if (!(source->file=fopen(path,"rb"))) {
+      sJSONfree(source);
+      return 0;
+   }
+   if (fread(magic,1,4,source->file)>=2 && magic[0]==0x1f && magic[1]==0x8b)
+      kind=SOURCE_GZIP;
+   else if (magic[0]==0x28 && magic[1]==0xb5 && magic[2]==0x2f && magic[3]==0xfd)
+      kind=SOURCE_ZSTD;
+   rewind(source->file);
+
+   if (kind==SOURCE_GZIP) {
+#ifdef SJSON_USE_ZLIB
+      fclose(source->file);
+      source->file=0;
+      if (!(source->gz=gzopen(path,"rb"))) {
+         close_file(source);
+         return 0;
+      }
+      gzbuffer(source->gz,SJSON_STREAM_BLOCK);
+      read=read_gzip;
+#endif
+   } else if (kind==SOURCE_ZSTD) {
+#ifdef SJSON_USE_ZSTD
+      source->zstd=ZSTD_createDStream();
+      source->in=(char*)sJSONmalloc(ZSTD_DStreamInSize());
+      if (!source->zstd || !source->in) {
+         close_file(source);
+         return 0;
+      }
+      ZSTD_initDStream(source->zstd);
+      source->input.src=source->in;
+      read=read_zstd;
+#endif
+   }
+   if (kind!=SOURCE_PLAIN && read==read_plain) {   /* codec not built in, the stream only reports it */
+      close_file(source);
+      if ((stream=sJSONstreamCreate(read_plain,0,options)))
+         stream->error=sJSON_StreamUnsupported;
+      return stream;
+   }
+
+#ifdef THREAD_SUPPORT_ENABLED
+   if (kind!=SOURCE_PLAIN) {     /* decode on a thread of its own */
+      readahead *ahead=new readahead;
+      ahead->read=read;
+      ahead->user=source;
+      ahead->close=close_file;
+      ahead->blocks[0]=(char*)sJSONmalloc(2*SJSON_STREAM_BLOCK);
+      ahead->blocks[1]=ahead->blocks[0]+SJSON_STREAM_BLOCK;
+      ahead->filled[0]=ahead->filled[1]=ahead->stop=false;
+      ahead->current=0;
+      ahead->pos=0;
+      if (!ahead->blocks[0] || !(stream=sJSONstreamCreate(read_buffered,ahead,options))) {
+         sJSONfree(ahead->blocks[0]);
+         delete ahead;
+         close_file(source);
+         return 0;
+      }
+      ahead->thread=std::thread(read_ahead,ahead);
+      stream->close=close_buffered;
+      return stream;
+   }
+#endif
+   if (!(stream=sJSONstreamCreate(read,source,options))) {
+      close_file(source);
+      return 0;
+   }
+   stream->close=close_file;
+   return stream;
+}
@@ -0,0 +1,70 @@
+/*
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include "sjson.h"
+
+#ifndef sJSONstream__h
+#define sJSONstream__h
+
+/* Pull reader for big or compressed sjson texts. The text is read in blocks and handed out one
+   record at a time: the members of the root object (bare or in braces), or the elements of a root
+   array. Only the record being parsed has to be in memory, not the whole text.
+
+   Compressed files are decoded while reading: gzip with SJSON_USE_ZLIB, zstd with SJSON_USE_ZSTD.
+   With THREAD_SUPPORT_ENABLED the decoding runs on a thread of its own, ahead of the parsing. */
+
+/* Read up to size bytes into buffer. Returns the count, 0 at the end, (size_t)-1 on error. */
+typedef size_t (*sJSON_StreamRead)(void *user, char *buffer, size_t size);
+
+typedef struct sJSON_Stream sJSON_Stream;
+
+/* sJSONstreamError codes. */
+#define sJSON_StreamOk 0
+#define sJSON_StreamReadError 1
+#define sJSON_StreamMalformed 2
+#define sJSON_StreamNoMemory 3
+#define sJSON_StreamUnsupported 4   /* compressed with a codec not built in */
+#define sJSON_StreamNotFound 5      /* the path of sJSONstreamSelect leads to no array or object */
+
+/* The lazy flags and the span table of options are ignored, the text doesn't stay in memory. With an
+   arena in options, records are parsed into it, so resetting it between records keeps memory flat. */
+extern sJSON_Stream *sJSONstreamCreate(sJSON_StreamRead read, void *user, const sJSON_ParseOptions *options);
+/* Stream a file, recognizing gzip and zstd by their magic bytes. 0 if it can't be opened. */
+extern sJSON_Stream *sJSONstreamOpen(const char *path, const sJSON_ParseOptions *options);
+/* Take the records from the array or object at path instead of the root, path being member names
+   separated by '.' (e.g. "export.rows"), before the first record is read. Everything around it is
+   skipped without parsing. 0 on memory fail or once reading has started. A path that names a
+   scalar, leads through an array or isn't there ends the records with sJSON_StreamNotFound. */
+extern int    sJSONstreamSelect(sJSON_Stream *stream, const char *path);
+/* The next record, 0 at the end or on error. Members come with their name. */
+extern sJSON *sJSONstreamNext(sJSON_Stream *stream);
+/* Called with each record, return 0 to stop. */
+typedef int (*sJSON_StreamCallback)(void *user, sJSON *record);
+/* Hand every record to callback, parsed into an arena which is reset when the callback returns, so
+   the record must not be kept (nor deleted). Memory stays bounded by the biggest record. Returns 0 on
+   error, see sJSONstreamError. */
+extern int    sJSONstreamEach(sJSON_Stream *stream, sJSON_StreamCallback callback, void *user);
+extern int    sJSONstreamError(const sJSON_Stream *stream);
+/* 1 if the records come from an array, also an empty one, once sJSONstreamNext has returned the
+   first record or the end. 0 for an object. */
+extern int    sJSONstreamIsArray(const sJSON_Stream *stream);
+extern void   sJSONstreamDelete(sJSON_Stream *stream);
+
+#endif
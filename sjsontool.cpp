@@ -0,0 +1,690 @@
+/*
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* sjson-tool: offline operations on sjson files, over the library APIs.
+
+   No build files ship with sJSON, build it with e.g.
+      g++ -O2 -DWRITE_SUPPORT_ENABLED sjsontool.cpp sjsonstream.cpp sjson.cpp sjsoncpu.cpp murmurhash.cpp -o sjson-tool
+   adding -DTHREAD_SUPPORT_ENABLED -pthread, -DSJSON_USE_ZLIB -lz and -DSJSON_USE_ZSTD -lzstd as wanted.
+
+   validate, minify, pretty and stats stream the input record by record, so they work on files larger
+   than memory and read gzip/zstd files as built in. With -path they take the records of a nested
+   array or object instead of the root. pack and bench need the whole tree. check tests the vector
+   kernels of every level the CPU supports against plain loops. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "sjsonstream.h"
+#include "sjsoncpu.h"
+
+#ifndef WRITE_SUPPORT_ENABLED
+   #error sjson-tool prints, build it with WRITE_SUPPORT_ENABLED
+#endif
+
+static const char *usage=
+   "usage: sjson-tool <command> [options] <file>...\n"
+   "  validate <file>...          check the syntax, report where it breaks\n"
+   "  minify [-o out] <file>      convert to strict JSON without formatting\n"
+   "  pretty [-o out] <file>      convert to formatted strict JSON\n"
+   "  pack -o out <file>          convert to the packed binary form\n"
+   "  unpack [-o out] <file>      convert the packed binary form to formatted JSON\n"
+   "  stats [-arena] <file>...    count nodes, bytes, estimated and peak memory, parsing each record\n"
+   "                              into a reused arena with -arena\n"
+   "  bench [-n runs] [-lazy] <file>  time parsing and printing\n"
+   "  bench [-n runs] -blob <file>  time base64 encoding and decoding of the file at each CPU level\n"
+   "  check                       test the vector kernels at every supported CPU level\n"
+   "validate, minify, pretty, pack and stats take -path a.b for the records of member b of member a.\n";
+
+static const char *selectPath;    /* -path, records of this container instead of the root */
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+   return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+
+/* Whole file, 0-terminated, or 0 with a message. */
+static char *read_file(const char *path, size_t *size) {
+   FILE *file=fopen(path,"rb");
+   char *text=0;
+   long len;
+   if (file && fseek(file,0,SEEK_END)==0 && (len=ftell(file))>=0 && fseek(file,0,SEEK_SET)==0
+      && (text=(char*)malloc((size_t)len+1))) {
+      *size=fread(text,1,(size_t)len,file);
+      text[*size]=0;
+   }
+   if (!text)
+      fprintf(stderr,"%s: can't read\n",path);
+   if (file)
+      fclose(file);
+   return text;
+}
+
+static int is_compressed(const char *text, size_t size) {
+   const unsigned char *magic=(const unsigned char*)text;
+   return (size>=2 && magic[0]==0x1f && magic[1]==0x8b)
+      || (size>=4 && magic[0]==0x28 && magic[1]==0xb5 && magic[2]==0x2f && magic[3]==0xfd);
+}
+
+static sJSON_Stream *open_stream(const char *path) {
+   sJSON_Stream *stream=sJSONstreamOpen(path,0);
+   if (!stream)
+      fprintf(stderr,"%s: can't open\n",path);
+   else if (selectPath && !sJSONstreamSelect(stream,selectPath)) {
+      fprintf(stderr,"%s: out of memory\n",path);
+      sJSONstreamDelete(stream);
+      stream=0;
+   }
+   return stream;
+}
+
+/* Report a failed stream, 1 if it failed. */
+static int stream_failed(sJSON_Stream *stream, const char *path) {
+   static const char *errors[]={"","read error","malformed","out of memory","compressed with a codec not built in",
+      "no array or object at the path"};
+   int error=sJSONstreamError(stream);
+   if (error)
+      fprintf(stderr,"%s: %s\n",path,errors[error]);
+   return error!=0;
+}
+
+/* Line and column of a parse error, from a full parse of the file. */
+static void report_parse_error(const char *path) {
+   size_t size;
+   char *text=read_file(path,&size);
+   sJSON *root=0;
+   if (!text)
+      return;
+   if (!is_compressed(text,size))
+      root=sJSONparse(text);
+   if (root || !sJSONgetErrorPtr()) {    /* no position to tell */
+      fprintf(stderr,"%s: malformed\n",path);
+      sJSONdelete(root);
+   } else {
+      const char *ep=sJSONgetErrorPtr(), *line=text;
+      int number=1;
+      for (const char *c=text;c<ep;c++)
+         if (*c=='\n') {
+            number++;
+            line=c+1;
+         }
+      int len=0;
+      while (len<20 && ep[len] && ep[len]!='\n' && ep[len]!='\r')
+         len++;
+      fprintf(stderr,"%s:%d:%d: parse error near \"%.*s\"\n",path,number,(int)(ep-line)+1,len,ep);
+   }
+   free(text);
+}
+
+static int cmd_validate(int argc, char **argv) {
+   int failed=0;
+   for (int i=0;i<argc;i++) {
+      sJSON_Stream *stream=open_stream(argv[i]);
+      sJSON *record;
+      size_t records=0;
+      if (!stream) {
+         failed=1;
+         continue;
+      }
+      while ((record=sJSONstreamNext(stream))) {
+         sJSONdelete(record);
+         records++;
+      }
+      if (sJSONstreamError(stream)==sJSON_StreamMalformed) {
+         report_parse_error(argv[i]);
+         failed=1;
+      } else if (stream_failed(stream,argv[i])) {
+         failed=1;
+      } else {
+         printf("%s: ok, %zu records\n",argv[i],records);
+      }
+      sJSONstreamDelete(stream);
+   }
+   return failed;
+}
+
+/* Write text, putting a tab behind each line break when indenting. */
+static void write_text(FILE *out, const char *text, int indent) {
+   if (!indent) {
+      fputs(text,out);
+      return;
+   }
+   for (const char *c=text;*c;c++) {
+      fputc(*c,out);
+      if (*c=='\n')
+         fputc('\t',out);
+   }
+}
+
+/* Print the records as the root object or array would be printed, one record in memory at a time. */
+static int cmd_convert(const char *path, FILE *out, int fmt) {
+   sJSON_Stream *stream=open_stream(path);
+   sJSON *record;
+   int count=0, object=1;
+   if (!stream)
+      return 1;
+   while ((record=sJSONstreamNext(stream))) {
+      char *text=fmt?sJSONprint(record):sJSONprintUnformatted(record);
+      if (!count) {
+         object=record->nameString!=0;
+         fputs(object?(fmt?"{\n":"{"):"[",out);
+      } else {
+         fputs(object?(fmt?",\n":","):(fmt?", ":","),out);
+      }
+      if (object) {
+         sJSON *name=sJSONcreateString(record->nameString);
+         char *key=sJSONprintUnformatted(name);
+         if (fmt)
+            fputc('\t',out);
+         fputs(key,out);
+         fputs(fmt?":\t":":",out);
+         free(key);
+         sJSONdelete(name);
+      }
+      write_text(out,text,fmt);
+      free(text);
+      sJSONdelete(record);
+      count++;
+   }
+   if (stream_failed(stream,path)) {
+      sJSONstreamDelete(stream);
+      return 1;
+   }
+   if (!count) {
+      object=!sJSONstreamIsArray(stream);
+      fputs(object?"{":"[",out);
+   }
+   fputs((object && fmt && count)?"\n}":(object?"}":"]"),out);
+   if (fmt)
+      fputc('\n',out);
+   sJSONstreamDelete(stream);
+   return 0;
+}
+
+/* Whole tree of a file, assembled from the records so compressed files work too. */
+static sJSON *load_tree(const char *path) {
+   sJSON_Stream *stream=open_stream(path);
+   sJSON *root=0, *record;
+   if (!stream)
+      return 0;
+   while ((record=sJSONstreamNext(stream))) {
+      if (!root)
+         root=record->nameString?sJSONcreateObject():sJSONcreateArray();
+      sJSONaddItemToArray(root,record);
+   }
+   if (stream_failed(stream,path)) {
+      sJSONdelete(root);
+      root=0;
+   } else if (!root) {
+      root=sJSONstreamIsArray(stream)?sJSONcreateArray():sJSONcreateObject();
+   }
+   sJSONstreamDelete(stream);
+   return root;
+}
+
+static int cmd_pack(const char *path, FILE *out) {
+   sJSON *root=load_tree(path);
+   sJSON_Packed *packed=root?sJSONpack(root):0;
+   int failed=!packed || fwrite(packed,1,sJSONpackedSize(packed),out)!=sJSONpackedSize(packed);
+   if (root && failed)
+      fprintf(stderr,"%s: can't pack\n",path);
+   sJSONfree(packed);
+   sJSONdelete(root);
+   return failed;
+}
+
+static int cmd_unpack(const char *path, FILE *out) {
+   size_t size;
+   char *data=read_file(path,&size);
+   const sJSON_Packed *packed=data?sJSONpackedFromBuffer(data,size):0;
+   sJSON *root=packed?sJSONunpack(packed):0;
+   char *text=root?sJSONprint(root):0;
+   if (data && !text)
+      fprintf(stderr,"%s: not a packed tree\n",path);
+   if (text) {
+      fputs(text,out);
+      fputc('\n',out);
+   }
+   free(text);
+   sJSONdelete(root);
+   free(data);
+   return !text;
+}
+
+typedef struct stats {
+   size_t types[7];     /* by type number */
+   size_t records, items, keys, keyBytes, stringBytes;
+   int depth;
+} stats;
+
+static void count_items(stats *s, sJSON *item, int depth) {
+   if (depth>s->depth)
+      s->depth=depth;
+   for (;item;item=item->next) {
+      int type=item->type&sJSON_TypeMask;
+      s->items++;
+      if (type<7)
+         s->types[type]++;
+      if (item->nameString) {
+         s->keys++;
+         s->keyBytes+=strlen(item->nameString)+1;
+      }
+      if (type==sJSON_String && sJSONgetString(item))
+         s->stringBytes+=strlen(sJSONgetString(item))+1;
+      count_items(s,item->child,depth+1);
+   }
+}
+
+static int count_record(void *user, sJSON *record) {
+   stats *s=(stats*)user;
+   count_items(s,record,2);
+   s->records++;
+   return 1;
+}
+
+static int cmd_stats(int argc, char **argv, int arena) {
+   static const char *names[7]={"false","true","null","number","string","array","object"};
+   int failed=0;
+   for (int i=0;i<argc;i++) {
+      std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+      sJSON_Stream *stream=open_stream(argv[i]);
+      sJSON *record;
+      struct rusage usage;
+      stats s;
+      if (!stream) {
+         failed=1;
+         continue;
+      }
+      memset(&s,0,sizeof(s));
+      if (arena) {
+         sJSONstreamEach(stream,count_record,&s);
+      } else {
+         while ((record=sJSONstreamNext(stream))) {
+            count_record(&s,record);
+            sJSONdelete(record);
+         }
+      }
+      if (stream_failed(stream,argv[i])) {
+         failed=1;
+      } else {
+         printf("%s: %zu records, %zu nodes, depth %d, %.3fs\n",argv[i],s.records,s.items+1,s.depth,seconds_since(start));
+         for (int t=0;t<7;t++)
+            if (s.types[t])
+               printf("   %-8s %zu\n",names[t],s.types[t]);
+         printf("   keys     %zu (%zu bytes)\n   strings  %zu bytes\n",s.keys,s.keyBytes,s.stringBytes);
+         printf("   memory   ~%zu bytes (%zu per node)\n",(s.items+1)*sizeof(sJSON)+s.keyBytes+s.stringBytes,sizeof(sJSON));
+         if (!getrusage(RUSAGE_SELF,&usage))
+            printf("   peak rss %ld kb (of the process so far)\n",(long)usage.ru_maxrss);
+      }
+      sJSONstreamDelete(stream);
+   }
+   return failed;
+}
+
+static int cmd_bench(const char *path, int runs, int flags) {
+   sJSON_ParseOptions options;
+   double parseBest=1e30, parseTotal=0, printBest=1e30, printTotal=0;
+   size_t size, printed=0;
+   char *text=read_file(path,&size);
+   if (!text)
+      return 1;
+   if (is_compressed(text,size)) {
+      fprintf(stderr,"%s: bench needs an uncompressed file\n",path);
+      free(text);
+      return 1;
+   }
+   memset(&options,0,sizeof(options));
+   options.flags=flags;
+   for (int i=0;i<runs;i++) {
+      std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+      sJSON *root=sJSONparseWithOptions(text,&options);
+      double parse=seconds_since(start), print;
+      char *out;
+      if (!root) {
+         report_parse_error(path);
+         free(text);
+         return 1;
+      }
+      start=std::chrono::steady_clock::now();
+      out=sJSONprintUnformatted(root);
+      print=seconds_since(start);
+      printed=out?strlen(out):0;
+      free(out);
+      sJSONdelete(root);
+      parseTotal+=parse;
+      printTotal+=print;
+      if (parse<parseBest)
+         parseBest=parse;
+      if (print<printBest)
+         printBest=print;
+   }
+   printf("%s: %zu bytes, %d runs\n",path,size,runs);
+   printf("   parse  best %.3fms  mean %.3fms  %.1f MB/s\n",parseBest*1e3,parseTotal/runs*1e3,size/parseBest/1e6);
+   printf("   print  best %.3fms  mean %.3fms  %.1f MB/s\n",printBest*1e3,printTotal/runs*1e3,printed/printBest/1e6);
+   free(text);
+   return 0;
+}
+
+/* The base64 kernels on the bytes of a file, at every level the CPU supports. */
+static int cmd_bench_blob(const char *path, int runs) {
+   size_t size, len;
+   char *data=read_file(path,&size), *text;
+   unsigned char *back;
+   int bound=sJSONcpuLevel(), failed=0;
+   if (!data)
+      return 1;
+   len=(size+2)/3*4;
+   text=(char*)malloc(len+1);
+   back=(unsigned char*)malloc(size+1);
+   if (!text || !back) {
+      fputs("bench: out of memory\n",stderr);
+      free(data);
+      free(text);
+      free(back);
+      return 1;
+   }
+   printf("%s: %zu bytes, %d runs\n",path,size,runs);
+   for (int level=sJSONcpuSupported();level>=sJSON_CpuScalar && !failed;level--) {
+      double encodeBest=1e30, decodeBest=1e30;
+      sJSONcpuSetLevel(level);
+      for (int i=0;i<runs && !failed;i++) {
+         std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+         double encode, decode;
+         sJSONkernels.base64Encode((const unsigned char*)data,size,text);
+         encode=seconds_since(start);
+         start=std::chrono::steady_clock::now();
+         failed=!sJSONkernels.base64Decode(text,len-(size%3?3-size%3:0),back);   /* without the padding */
+         decode=seconds_since(start);
+         failed|=memcmp(back,data,size)!=0;
+         if (encode<encodeBest)
+            encodeBest=encode;
+         if (decode<decodeBest)
+            decodeBest=decode;
+      }
+      if (failed)
+         fprintf(stderr,"%s: base64 round trip failed at %s\n",path,sJSONcpuLevelName(level));
+      else
+         printf("   %-7s encode %.1f MB/s  decode %.1f MB/s (of binary data)\n",sJSONcpuLevelName(level),size/encodeBest/1e6,size/decodeBest/1e6);
+   }
+   sJSONcpuSetLevel(bound);
+   free(data);
+   free(text);
+   free(back);
+   return failed;
+}
+
+/* size bytes (a multiple of the page size) followed by an inaccessible page, so reads past the end
+   fault. 0 if it can't be mapped. */
+static char *guarded_alloc(size_t size, size_t page) {
+   char *base=(char*)mmap(0,size+page,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+   if (base==MAP_FAILED)
+      return 0;
+   if (mprotect(base+size,page,PROT_NONE)) {
+      munmap(base,size+page);
+      return 0;
+   }
+   return base;
+}
+
+static const char *expect_string(const char *str) {
+   while (*str!='\"' && *str!='\\' && *str)
+      str++;
+   return str;
+}
+
+static const char *expect_plain(const char *str, const char *end) {
+   while (str<end && (unsigned char)*str>31 && *str!='\"' && *str!='\\')
+      str++;
+   return str;
+}
+
+/* len chars at str without stop chars, but high and 7-bit ones mixed, then stop at pos (if pos<len). */
+static void fill_scan(char *str, size_t len, size_t pos, char stop) {
+   static const char filler[]=" a~\x7f\x80\xff\xe9";
+   for (size_t i=0;i<len;i++)
+      str[i]=filler[(i*5+len)%7];
+   if (pos<len)
+      str[pos]=stop;
+}
+
+/* The scan kernels of the bound level against plain loops: every length up to a few vectors with
+   each stop char at every position, placed at every alignment and ending right at the guard page. */
+static int check_scans(char *area, size_t size) {
+   static const char stops[]={'\"','\\',0,0x01,0x1f};     /* control chars only stop scanPlain */
+   char *end=area+size;
+   for (size_t len=0;len<=130;len++)
+      for (size_t pos=0;pos<=len;pos++)
+         for (size_t k=0;k<sizeof(stops);k++)
+            for (int align=-1;align<64;align++) {   /* -1: at the end of the area */
+               char *str=(align<0)?end-len-1:area+align;
+               const char *got, *want;
+               fill_scan(str,len,pos,stops[k]);
+               str[len]=0;
+               if ((got=sJSONkernels.scanString(str))!=(want=expect_string(str))) {
+                  fprintf(stderr,"scanString: length %zu, stop 0x%02x at %zu, alignment %d: %d instead of %d\n",
+                     len,stops[k],pos,align,(int)(got-str),(int)(want-str));
+                  return 1;
+               }
+               if (align<0) {    /* not terminated, the end of the range is the end of the area */
+                  str++;
+                  fill_scan(str,len,pos,stops[k]);
+               }
+               if ((got=sJSONkernels.scanPlain(str,str+len))!=(want=expect_plain(str,str+len))) {
+                  fprintf(stderr,"scanPlain: length %zu, stop 0x%02x at %zu, alignment %d: %d instead of %d\n",
+                     len,stops[k],pos,align,(int)(got-str),(int)(want-str));
+                  return 1;
+               }
+            }
+   return 0;
+}
+
+static const char base64Chars[]="ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* Base64 of size bytes with padding, 0-terminated. */
+static void expect_base64(const unsigned char *data, size_t size, char *out) {
+   for (size_t i=0;i<size;i+=3) {
+      unsigned v=(unsigned)data[i]<<16 | (i+1<size?(unsigned)data[i+1]<<8:0) | (i+2<size?data[i+2]:0);
+      *out++=base64Chars[v>>18];
+      *out++=base64Chars[(v>>12)&63];
+      *out++=(i+1<size)?base64Chars[(v>>6)&63]:'=';
+      *out++=(i+2<size)?base64Chars[v&63]:'=';
+   }
+   *out=0;
+}
+
+/* A blob through the API: decoded from text (padded or not) parsed with flags, 0 if that gives
+   anything but the size bytes of data. */
+static int blob_matches(const char *text, int flags, const unsigned char *data, size_t size) {
+   sJSON_ParseOptions options;
+   sJSON *root;
+   unsigned char *out=(unsigned char*)malloc(size+1);
+   int ok;
+   memset(&options,0,sizeof(options));
+   options.flags=flags;
+   root=sJSONparseWithOptions(text,&options);
+   ok=root && out && root->child && sJSONgetBlobSize(root->child)==size
+      && sJSONgetBlob(root->child,out,size)==size && !memcmp(out,data,size)
+      && (!(flags&sJSON_ParseLazyStrings) || (root->child->type&sJSON_IsLazy));    /* decoded from the source */
+   sJSONdelete(root);
+   free(out);
+   return ok;
+}
+
+/* The base64 kernels of the bound level: encoding against a plain loop, decoding back, rejecting a
+   char outside the alphabet anywhere, with input and output ending right at the guard page. Then
+   blobs through the API, padded, unpadded and lazily parsed, and texts of len%4==1 rejected. */
+static int check_blobs(char *area, size_t size) {
+   char *end=area+size, text[300], json[320];
+   unsigned char data[200];
+   for (size_t n=0;n<sizeof(data);n++) {
+      size_t len=(n+2)/3*4, unpadded=len-(n%3?3-n%3:0);
+      unsigned char *src=(unsigned char*)end-n;
+      char *out=end-len;
+      sJSON *blob;
+      char *printed;
+      for (size_t i=0;i<n;i++)
+         data[i]=(unsigned char)(i*151+n*7+(i>>3));
+      expect_base64(data,n,text);
+      memcpy(src,data,n);
+      sJSONkernels.base64Encode(src,n,out);
+      if (memcmp(out,text,len)) {
+         fprintf(stderr,"base64Encode: %zu bytes encoded wrong\n",n);
+         return 1;
+      }
+      src=(unsigned char*)end-n;    /* decode the unpadded text, ending at the guard page too */
+      memcpy(area,text,unpadded);
+      memset(src,0,n);
+      if (!sJSONkernels.base64Decode(area,unpadded,src) || memcmp(src,data,n)) {
+         fprintf(stderr,"base64Decode: %zu bytes decoded wrong\n",n);
+         return 1;
+      }
+      for (size_t i=0;i<unpadded;i++) {
+         memcpy(area,text,unpadded);
+         area[i]=(i&1)?'!':(char)0xc3;
+         if (sJSONkernels.base64Decode(area,unpadded,src)) {
+            fprintf(stderr,"base64Decode: %zu chars, bad char at %zu accepted\n",unpadded,i);
+            return 1;
+         }
+      }
+      if (!(blob=sJSONcreateBlob(data,n)) || !(printed=sJSONprintUnformatted(blob))) {
+         sJSONdelete(blob);
+         return 1;
+      }
+      snprintf(json,sizeof(json),"[%s]",printed);
+      free(printed);
+      sJSONdelete(blob);
+      if (!blob_matches(json,0,data,n) || !blob_matches(json,sJSON_ParseLazyStrings,data,n)) {
+         fprintf(stderr,"blob of %zu bytes, padded: decoded wrong\n",n);
+         return 1;
+      }
+      snprintf(json,sizeof(json),"[\"%.*s\"]",(int)unpadded,text);
+      if (!blob_matches(json,0,data,n) || !blob_matches(json,sJSON_ParseLazyStrings,data,n)) {
+         fprintf(stderr,"blob of %zu bytes, unpadded: decoded wrong\n",n);
+         return 1;
+      }
+      if (len>=4) {     /* one char more than a full group */
+         snprintf(json,sizeof(json),"[\"%.*sQ\"]",(int)(len-4),text);
+         if (blob_matches(json,0,data,n)) {
+            fprintf(stderr,"blob of %zu chars accepted\n",len-3);
+            return 1;
+         }
+         sJSON *root=sJSONparse(json);
+         int accepted=root && (sJSONgetBlobSize(root->child)!=(size_t)-1 || sJSONgetBlob(root->child,data,sizeof(data))!=(size_t)-1);
+         sJSONdelete(root);
+         if (accepted) {
+            fprintf(stderr,"blob of %zu chars accepted\n",len-3);
+            return 1;
+         }
+      }
+   }
+   return 0;
+}
+
+static int cmd_check() {
+   size_t page=(size_t)sysconf(_SC_PAGESIZE), size=2*page;
+   char *area=guarded_alloc(size,page);
+   int bound=sJSONcpuLevel(), failed=0;
+   if (!area) {
+      fputs("check: can't map memory\n",stderr);
+      return 1;
+   }
+   printf("cpu supports %s, bound to %s\n",sJSONcpuLevelName(sJSONcpuSupported()),sJSONcpuLevelName(bound));
+   for (int level=sJSONcpuSupported();level>=sJSON_CpuScalar;level--) {
+      int bad;
+      fflush(stdout);      /* keep the order with the messages on stderr */
+      sJSONcpuSetLevel(level);
+      bad=check_scans(area,size);
+      printf("   %-7s scan %s",sJSONcpuLevelName(level),bad?"FAILED":"ok");
+      fflush(stdout);
+      failed|=bad;
+      bad=check_blobs(area,size);
+      printf(", base64 %s\n",bad?"FAILED":"ok");
+      failed|=bad;
+   }
+   sJSONcpuSetLevel(bound);
+   munmap(area,size+page);
+   return failed;
+}
+
+int main(int argc, char **argv) {
+   const char *command, *output=0;
+   FILE *out=stdout;
+   int runs=10, flags=0, blob=0, arena=0, first=2, result;
+   if (argc==2 && !strcmp(argv[1],"check"))
+      return cmd_check();
+   if (argc<3) {
+      fputs(usage,stderr);
+      return 2;
+   }
+   command=argv[1];
+   for (;first<argc && argv[first][0]=='-';first++) {
+      if (!strcmp(argv[first],"-o") && first+1<argc)
+         output=argv[++first];
+      else if (!strcmp(argv[first],"-n") && first+1<argc && atoi(argv[first+1])>0)
+         runs=atoi(argv[++first]);
+      else if (!strcmp(argv[first],"-lazy"))
+         flags=sJSON_ParseLazyNumbers|sJSON_ParseLazyStrings;
+      else if (!strcmp(argv[first],"-blob"))
+         blob=1;
+      else if (!strcmp(argv[first],"-arena"))
+         arena=1;
+      else if (!strcmp(argv[first],"-path") && first+1<argc)
+         selectPath=argv[++first];
+      else
+         break;
+   }
+   if (first>=argc) {
+      fputs(usage,stderr);
+      return 2;
+   }
+   if (!strcmp(command,"validate"))
+      return cmd_validate(argc-first,argv+first);
+   if (!strcmp(command,"stats"))
+      return cmd_stats(argc-first,argv+first,arena);
+   if (!strcmp(command,"bench"))
+      return blob?cmd_bench_blob(argv[first],runs):cmd_bench(argv[first],runs,flags);
+
+   if (!strcmp(command,"pack") && !output) {
+      fputs("pack needs -o\n",stderr);
+      return 2;
+   }
+   if (output && !(out=fopen(output,"wb"))) {
+      fprintf(stderr,"%s: can't write\n",output);
+      return 1;
+   }
+   if (!strcmp(command,"minify"))
+      result=cmd_convert(argv[first],out,0);
+   else if (!strcmp(command,"pretty"))
+      result=cmd_convert(argv[first],out,1);
+   else if (!strcmp(command,"pack"))
+      result=cmd_pack(argv[first],out);
+   else if (!strcmp(command,"unpack"))
+      result=cmd_unpack(argv[first],out);
+   else {
+      fputs(usage,stderr);
+      result=2;
+   }
+   if (out!=stdout && fclose(out))
+      result=1;
+   return result;
+}